@@ -0,0 +1,54 @@
+#include "AudioOutput.h"
+
+#include <algorithm>
+
+namespace
+{
+	//samples per audio thread callback, about 10 ms
+	constexpr size_t CHUNK_SAMPLES = 480;
+}
+
+AudioOutput::AudioOutput(unsigned inputRate, unsigned latencyMs)
+	: inputRate(inputRate), targetFill(size_t(OUTPUT_RATE) * latencyMs / 1000), ring(targetFill * 4), chunk(CHUNK_SAMPLES)
+{
+	initialize(1, OUTPUT_RATE);
+}
+
+AudioOutput::~AudioOutput()
+{
+	//the audio thread calls onGetData, it has to be gone before the members are
+	stop();
+}
+
+void AudioOutput::push(const int16_t* samples, size_t count)
+{
+	//above the target the ratio goes up and fewer samples come out, below it more
+	double fill = double(ring.size());
+	double error = (fill - targetFill) / targetFill;
+	double adjust = 1.0 + MAX_ADJUST * std::clamp(error, -1.0, 1.0);
+	ratio.store(adjust, std::memory_order_relaxed);
+
+	resampled.clear();
+	resampler.process(samples, count, double(inputRate) / OUTPUT_RATE * adjust, resampled);
+
+	size_t pushed = ring.push(resampled.data(), resampled.size());
+	if (pushed < resampled.size())
+		overruns.fetch_add(resampled.size() - pushed, std::memory_order_relaxed);
+}
+
+bool AudioOutput::onGetData(Chunk& data)
+{
+	size_t count = ring.pop(chunk.data(), chunk.size());
+	if (count > 0)
+		lastSample = chunk[count - 1];
+	if (count < chunk.size())
+	{
+		//hold the last level instead of dropping to 0, a jump to silence clicks
+		underruns.fetch_add(1, std::memory_order_relaxed);
+		std::fill(chunk.begin() + count, chunk.end(), lastSample);
+	}
+
+	data.samples = chunk.data();
+	data.sampleCount = chunk.size();
+	return true;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <SFML/Audio.hpp>
+
+#include "Resampler.h"
+#include "SpscRing.h"
+
+//Plays the apu's samples on SFML's audio thread.
+//The emulation side pushes whatever the apu made, it is resampled to 48 kHz and goes into a
+//lock-free ring that the audio thread drains, so neither side ever waits for the other.
+//The resampling ratio is nudged (by at most MAX_ADJUST) towards keeping the ring at its target fill:
+//if the emulator runs a little fast the ring fills up and fewer output samples are made, if it
+//runs slow the ring drains and more are made. Frame rate jitter is absorbed by the ring, only a
+//lasting difference between the emulated and real sample clocks moves the ratio.
+class AudioOutput : public sf::SoundStream
+{
+public:
+	static constexpr unsigned OUTPUT_RATE = 48000;
+	static constexpr double MAX_ADJUST = 0.005;
+
+private:
+	unsigned inputRate;
+	size_t targetFill;
+	SpscRing<int16_t> ring;
+	Resampler resampler;
+	std::vector<int16_t> resampled;
+	std::atomic<double> ratio{ 1.0 };
+
+	//audio thread side
+	std::vector<int16_t> chunk;
+	int16_t lastSample = 0;
+
+	std::atomic<uint64_t> underruns{ 0 };
+	std::atomic<uint64_t> overruns{ 0 };
+
+	bool onGetData(Chunk& data) override;
+	void onSeek(sf::Time) override {}
+
+public:
+	//latency is the target fill of the ring, the ring holds four times that
+	AudioOutput(unsigned inputRate, unsigned latencyMs = 50);
+	~AudioOutput();
+
+	//emulation thread: samples at inputRate
+	void push(const int16_t* samples, size_t count);
+
+	//callbacks that found the ring short, and samples dropped because it was full
+	uint64_t underrunCount() const { return underruns.load(std::memory_order_relaxed); }
+	uint64_t overrunCount() const { return overruns.load(std::memory_order_relaxed); }
+	//ms of audio queued and the current ratio correction, 1.0 is none
+	double fillMs() const { return ring.size() * 1000.0 / OUTPUT_RATE; }
+	double rateAdjust() const { return ratio.load(std::memory_order_relaxed); }
+};
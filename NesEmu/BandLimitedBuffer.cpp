@@ -0,0 +1,114 @@
+#include "BandLimitedBuffer.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	//cutoff at 45% of the output rate, just under nyquist
+	constexpr double CUTOFF = 0.45;
+	constexpr double PI = 3.14159265358979323846;
+	//pole of the dc blocker, about 20 Hz at 48 kHz
+	constexpr float DC_POLE = 0.9975f;
+}
+
+const float (*BandLimitedBuffer::kernel())[WIDTH]
+{
+	//one impulse per sub-sample phase, each normalised to 1 so a step comes out at its exact height.
+	//Impulses are shifted by WIDTH / 2 samples so they never reach back before the delta.
+	static const auto table = []
+	{
+		std::vector<float> steps(PHASES * WIDTH);
+		for (int phase = 0; phase < PHASES; phase++)
+		{
+			double sum = 0.0;
+			double taps[WIDTH];
+			for (int i = 0; i < WIDTH; i++)
+			{
+				double x = i - (WIDTH / 2 - 1) - double(phase) / PHASES;
+				double sinc = x == 0.0 ? 1.0 : std::sin(2.0 * PI * CUTOFF * x) / (2.0 * PI * CUTOFF * x);
+				double w = (i + 1 - double(phase) / PHASES) / WIDTH;
+				double blackman = 0.42 - 0.5 * std::cos(2.0 * PI * w) + 0.08 * std::cos(4.0 * PI * w);
+				taps[i] = sinc * blackman;
+				sum += taps[i];
+			}
+			for (int i = 0; i < WIDTH; i++)
+				steps[phase * WIDTH + i] = float(taps[i] / sum);
+		}
+		return steps;
+	}();
+
+	return reinterpret_cast<const float (*)[WIDTH]>(table.data());
+}
+
+BandLimitedBuffer::BandLimitedBuffer(double clockRate, unsigned sampleRate, size_t maxSamples)
+	: maxSamples(maxSamples)
+{
+	setRates(clockRate, sampleRate);
+	impulses.resize(4096, 0.0f);
+}
+
+void BandLimitedBuffer::setRates(double clockRate, unsigned sampleRate)
+{
+	factor = (uint64_t)std::llround(sampleRate / clockRate * 4294967296.0);
+}
+
+void BandLimitedBuffer::endFrame(uint32_t clocks)
+{
+	offset += clocks * factor;
+	available += (size_t)(offset >> 32);
+	offset &= 0xFFFFFFFFull;
+
+	if (available + WIDTH > impulses.size())
+		impulses.resize(available + WIDTH + 1024, 0.0f);
+	if (available > maxSamples)
+		drop(available - maxSamples);
+}
+
+void BandLimitedBuffer::discardFrame()
+{
+	std::fill(impulses.begin() + available, impulses.end(), 0.0f);
+	offset = 0;
+}
+
+void BandLimitedBuffer::clear()
+{
+	std::fill(impulses.begin(), impulses.end(), 0.0f);
+	available = 0;
+	offset = 0;
+	level = 0.0f;
+	dcInput = 0.0f;
+	dcOutput = 0.0f;
+}
+
+float BandLimitedBuffer::integrate(float impulse)
+{
+	level += impulse;
+	float sample = level - dcInput + DC_POLE * dcOutput;
+	dcInput = level;
+	dcOutput = sample;
+	return sample;
+}
+
+void BandLimitedBuffer::consume(size_t count)
+{
+	impulses.erase(impulses.begin(), impulses.begin() + count);
+	impulses.resize(impulses.size() + count, 0.0f);
+	available -= count;
+}
+
+void BandLimitedBuffer::drop(size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		integrate(impulses[i]);
+	consume(count);
+}
+
+size_t BandLimitedBuffer::readSamples(int16_t* out, size_t count, float scale)
+{
+	count = std::min(count, available);
+	for (size_t i = 0; i < count; i++)
+		out[i] = (int16_t)std::clamp(integrate(impulses[i]) * scale * 32767.0f, -32768.0f, 32767.0f);
+	consume(count);
+	return count;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cinttypes>
+#include <cstddef>
+#include <vector>
+
+//Band-limited step synthesis for square-ish waves.
+//Instead of sampling the waveform on every input clock, the caller adds a delta at the clock each
+//time the level changes. Every delta is spread over WIDTH output samples with a windowed sinc step
+//picked from PHASES sub-sample offsets, so the output has no aliasing above the cutoff and the cost
+//is per level change and per output sample, not per input clock.
+//Samples become readable once endFrame moves past them, deltas go in relative to the frame start.
+class BandLimitedBuffer
+{
+public:
+	static constexpr int PHASES = 32;
+	static constexpr int WIDTH = 16;
+
+private:
+	//output samples per input clock, 32.32 fixed point
+	uint64_t factor = 0;
+	//fractional sample position of the frame start
+	uint64_t offset = 0;
+	//impulses not integrated yet, the first `available` entries are finished samples
+	std::vector<float> impulses;
+	size_t available = 0;
+	size_t maxSamples = 0;
+
+	//running sum of the impulses and the dc blocker after it
+	float level = 0.0f;
+	float dcInput = 0.0f;
+	float dcOutput = 0.0f;
+
+	float integrate(float impulse);
+	//removes count finished samples from the front
+	void consume(size_t count);
+	void drop(size_t count);
+
+public:
+	//samples past maxSamples that nobody read are dropped from the oldest end
+	BandLimitedBuffer(double clockRate, unsigned sampleRate, size_t maxSamples);
+
+	void setRates(double clockRate, unsigned sampleRate);
+
+	//clock is relative to the start of the current frame
+	void addDelta(uint32_t clock, float delta)
+	{
+		uint64_t position = offset + clock * factor;
+		size_t index = available + (size_t)(position >> 32);
+		if (index + WIDTH > impulses.size())
+			impulses.resize(index + WIDTH + 1024, 0.0f);
+
+		const float* step = kernel()[(position >> (32 - 5)) & (PHASES - 1)];
+		float* out = impulses.data() + index;
+		for (int i = 0; i < WIDTH; i++)
+			out[i] += step[i] * delta;
+	}
+
+	//ends the frame after clocks input clocks, the samples before it can be read
+	void endFrame(uint32_t clocks);
+	//drops impulses that aren't finished samples yet, for when the source jumps in time
+	void discardFrame();
+	void clear();
+
+	size_t samplesAvailable() const { return available; }
+	//16-bit signed samples, scale 1.0 = full range
+	size_t readSamples(int16_t* out, size_t count, float scale);
+
+private:
+	static const float (*kernel())[WIDTH];
+};
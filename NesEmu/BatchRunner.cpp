@@ -0,0 +1,150 @@
+#include "BatchRunner.h"
+#include "Bus.h"
+#include "ThreadPool.h"
+
+#include <chrono>
+#include <iomanip>
+
+namespace
+{
+	//$80 while the test runs, $81 when it wants the reset button pressed
+	constexpr uint8_t STATUS_RUNNING = 0x80;
+	constexpr uint8_t STATUS_NEEDS_RESET = 0x81;
+	//blargg asks for at least 100 ms before the reset
+	constexpr size_t RESET_DELAY_FRAMES = 6;
+
+	bool hasSignature(Bus& bus)
+	{
+		return bus.cpuRead(0x6001) == 0xDE && bus.cpuRead(0x6002) == 0xB0 && bus.cpuRead(0x6003) == 0x61;
+	}
+
+	std::string readMessage(Bus& bus)
+	{
+		std::string message;
+		for (uint16_t addr = 0x6004; addr < 0x8000; addr++)
+		{
+			char c = (char)bus.cpuRead(addr);
+			if (c == 0)
+				break;
+			message += c;
+		}
+		return message;
+	}
+
+	void runRom(BatchResult& result, const BatchOptions& options)
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		auto cart = std::make_shared<Cartridge>(result.rom);
+		if (!cart->imageValid())
+		{
+			result.outcome = BatchResult::Outcome::Error;
+			result.message = "rom could not be loaded";
+			return;
+		}
+
+		auto bus = std::make_unique<Bus>();
+		bus->insertCartridge(cart);
+		bus->reset();
+		bus->ppu.setRendering(false);
+		bus->apu.setOutput(false);
+
+		//the clock counter restarts on reset, cycles before it are added up here
+		uint64_t dotsBeforeReset = 0;
+		size_t resetAt = 0;
+		result.outcome = BatchResult::Outcome::Timeout;
+
+		for (result.frames = 0; result.frames < options.frameLimit; result.frames++)
+		{
+			bus->runFrame();
+
+			if (resetAt != 0 && result.frames >= resetAt)
+			{
+				dotsBeforeReset += bus->getClockCounter();
+				bus->reset();
+				resetAt = 0;
+				continue;
+			}
+
+			if (!hasSignature(*bus))
+				continue;
+
+			uint8_t status = bus->cpuRead(0x6000);
+			if (status == STATUS_NEEDS_RESET && resetAt == 0)
+				resetAt = result.frames + RESET_DELAY_FRAMES;
+			else if (status < STATUS_RUNNING)
+			{
+				result.status = status;
+				result.outcome = status == 0 ? BatchResult::Outcome::Pass : BatchResult::Outcome::Fail;
+				result.frames++;
+				break;
+			}
+		}
+
+		if (hasSignature(*bus))
+			result.message = readMessage(*bus);
+		result.cpuCycles = (dotsBeforeReset + bus->getClockCounter()) / 3;
+		result.wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	const char* outcomeName(BatchResult::Outcome outcome)
+	{
+		switch (outcome)
+		{
+		case BatchResult::Outcome::Pass: return "pass";
+		case BatchResult::Outcome::Fail: return "fail";
+		case BatchResult::Outcome::Timeout: return "timeout";
+		default: return "error";
+		}
+	}
+
+	void writeString(std::ostream& out, const std::string& text)
+	{
+		out << '"';
+		for (char c : text)
+		{
+			if (c == '"' || c == '\\')
+				out << '\\' << c;
+			else if (c == '\n')
+				out << "\\n";
+			else if ((unsigned char)c < 0x20 || (unsigned char)c >= 0x7F)
+				out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int)(unsigned char)c << std::dec;
+			else
+				out << c;
+		}
+		out << '"';
+	}
+}
+
+std::vector<BatchResult> runBatch(const std::vector<std::string>& roms, const BatchOptions& options, ThreadPool& pool)
+{
+	std::vector<BatchResult> results(roms.size());
+	for (size_t i = 0; i < roms.size(); i++)
+	{
+		results[i].rom = roms[i];
+		pool.submit([&results, &options, i] { runRom(results[i], options); });
+	}
+
+	pool.wait();
+	return results;
+}
+
+void writeReport(std::ostream& out, const std::vector<BatchResult>& results)
+{
+	out << "[\n";
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const BatchResult& result = results[i];
+		out << "  {\"rom\": ";
+		writeString(out, result.rom);
+		out << ", \"result\": \"" << outcomeName(result.outcome) << "\"";
+		out << ", \"status\": " << result.status;
+		out << ", \"message\": ";
+		writeString(out, result.message);
+		out << ", \"frames\": " << result.frames;
+		out << ", \"cpu_cycles\": " << result.cpuCycles;
+		out << ", \"wall_ms\": " << std::fixed << std::setprecision(1) << result.wallMs << std::defaultfloat;
+		out << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+	out << "]\n";
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cinttypes>
+#include <ostream>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+struct BatchOptions
+{
+	//a rom that hasn't reported a result by then is a timeout
+	size_t frameLimit = 60 * 60;
+};
+
+struct BatchResult
+{
+	enum class Outcome
+	{
+		Pass,
+		Fail,
+		Timeout,
+		Error
+	};
+
+	std::string rom;
+	Outcome outcome = Outcome::Error;
+	//blargg status byte, 0 passed, $01-$7F failure code, -1 if the rom never reported one
+	int status = -1;
+	std::string message;
+	size_t frames = 0;
+	uint64_t cpuCycles = 0;
+	double wallMs = 0.0;
+};
+
+//Runs every rom on its own headless machine, one pool job per rom, results in the order of roms.
+//A run ends when the rom reports a result the way blargg's test roms do ($6001-$6003 = DE B0 61,
+//status at $6000, text at $6004) or when the frame limit is hit.
+std::vector<BatchResult> runBatch(const std::vector<std::string>& roms, const BatchOptions& options, ThreadPool& pool);
+
+//JSON array, one object per rom: rom, result, status, message, frames, cpu_cycles, wall_ms
+void writeReport(std::ostream& out, const std::vector<BatchResult>& results);
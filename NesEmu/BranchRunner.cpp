@@ -0,0 +1,33 @@
+#include "BranchRunner.h"
+#include "Bus.h"
+#include "Common.h"
+#include "ThreadPool.h"
+
+std::vector<BranchResult> runBranches(const Bus& root, const std::vector<std::vector<uint8_t>>& inputs, ThreadPool& pool)
+{
+	std::vector<BranchResult> results(inputs.size());
+
+	for (size_t i = 0; i < inputs.size(); i++)
+	{
+		pool.submit([&, i]
+		{
+			std::unique_ptr<Bus> branch = root.fork();
+			branch->apu.setOutput(false);
+			for (uint8_t buttons : inputs[i])
+			{
+				branch->controller[0] = buttons;
+				branch->runFrame();
+			}
+
+			const auto& ram = branch->getRam();
+			results[i].ramHash = fnv1a(ram.data(), ram.size());
+
+			const uint8_t* frame = branch->ppu.getFrameBuffer();
+			if (frame != nullptr)
+				results[i].frameHash = fnv1a(frame, nes2c02::SCREEN_WIDTH * nes2c02::SCREEN_HEIGHT);
+		});
+	}
+
+	pool.wait();
+	return results;
+}
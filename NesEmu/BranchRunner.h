@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cinttypes>
+#include <vector>
+
+class Bus;
+class ThreadPool;
+
+struct BranchResult
+{
+	uint64_t ramHash = 0;
+	uint64_t frameHash = 0;
+};
+
+//Runs every input sequence from a fork of root, one sequence per branch spread over the pool.
+//Each byte of a sequence is the first pad's buttons for one frame. The hashes are taken after the
+//last frame of the branch. root must not be clocked while the branches run.
+std::vector<BranchResult> runBranches(const Bus& root, const std::vector<std::vector<uint8_t>>& inputs, ThreadPool& pool);
@@ -1,53 +1,331 @@
 #include "Bus.h"
+#include "PpuThread.h"
+#include "SaveState.h"
+
+Bus::Bus()
+	:cpu(this), apu(this)
+{
+	cpuRam.fill(0);
+}
+
+Bus::~Bus() = default;
 
 void Bus::cpuWrite(uint16_t addr, uint8_t data)
 {
-	if (cartridge->cpuWrite(addr, data))
-	{
+	if (writeWatch == (addr <= 0x1FFF ? addr & 0x07FF : addr))
+		watchHit = true;
 
+	bool claimed = cartridge->cpuWrite(addr, data);
+	countAccess(claimed ? Profiler::Region::Cartridge : Profiler::region(addr), true);
+	if (claimed)
+	{
+		if (addr >= 0x8000)
+		{
+			for (int bank = 8; bank < 16; bank++)
+				bankVersion[bank]++;
+		}
+		else
+			bankVersion[addr >> 12]++;
 	}
 	else if (addr >= 0x0000 && addr <= 0x1FFF)
+	{
+		//the mirrors span both banks
 		cpuRam[addr & 0x07FF] = data;
+		bankVersion[0]++;
+		bankVersion[1]++;
+	}
 	else if (addr >= 0x2000 && addr <= 0x3FFF)
-		ppu.cpuWrite(addr & 0x0007, data);
+	{
+		if (ppuThread)
+			ppuThread->write(ppuTime(), addr & 0x0007, data);
+		else
+			ppu.cpuWrite(addr & 0x0007, data);
+	}
+	else if (addr == 0x4016)
+	{
+		//the pads latch their buttons for as long as the strobe is high, the last latch is the one read
+		if (controllerStrobe || (data & 0x01))
+		{
+			controllerShift[0] = controller[0];
+			controllerShift[1] = controller[1];
+		}
+		controllerStrobe = data & 0x01;
+	}
+	else if ((addr >= 0x4000 && addr <= 0x4013) || addr == 0x4015 || addr == 0x4017)
+	{
+		apu.cpuWrite(addr, data, systemClockCounter / 3);
+		apuDue = (size_t)apu.nextEvent() * 3;
+	}
 }
 
 uint8_t Bus::cpuRead(uint16_t addr)
 {
 	uint8_t data = 0;
-	if (cartridge->cpuRead(addr, data))
+	bool claimed = cartridge->cpuRead(addr, data);
+	countAccess(claimed ? Profiler::Region::Cartridge : Profiler::region(addr), false);
+	if (claimed)
 		return data;
 	else if (addr >= 0x0000 && addr <= 0x1FFF)
 		return cpuRam[addr & 0x07FF];
 	else if (addr >= 0x2000 && addr <= 0x3FFF)
-		return ppu.cpuRead(addr & 0x0007);
+		return ppuThread ? ppuThread->read(ppuTime(), addr & 0x0007) : ppu.cpuRead(addr & 0x0007);
+	else if (addr == 0x4015)
+	{
+		data = apu.cpuRead(addr, systemClockCounter / 3);
+		apuDue = (size_t)apu.nextEvent() * 3;
+		return data;
+	}
+	else if (addr == 0x4016 || addr == 0x4017)
+	{
+		//one button per read, A first, then 1s once all 8 are out. Bit 6 is open bus ($40 from the address).
+		int port = addr & 0x0001;
+		if (controllerStrobe)
+			controllerShift[port] = controller[port];
+		data = controllerShift[port] & 0x01;
+		controllerShift[port] = (controllerShift[port] >> 1) | 0x80;
+		return data | 0x40;
+	}
 
 	return data;
 }
 
 void Bus::insertCartridge(std::shared_ptr<Cartridge> cartridge)
 {
+	syncPpu();
 	this->cartridge = cartridge;
+	forkedCartridge = false;
 	ppu.insertCartridge(cartridge);
+	touchAllBanks();
+}
+
+void Bus::touchAllBanks()
+{
+	for (uint32_t& version : bankVersion)
+		version++;
 }
 
 void Bus::reset()
 {
+	syncPpu();
 	cartridge->reset();
 	cpu.reset();
 	ppu.reset();
+	apu.reset();
+	apuDue = 0;
+	controllerShift[0] = 0;
+	controllerShift[1] = 0;
+	controllerStrobe = false;
 	systemClockCounter = 0;
+	touchAllBanks();
+	if (ppuThread)
+		ppuThread->rebase(systemClockCounter);
+}
+
+void Bus::powerOn()
+{
+	syncPpu();
+	cpuRam.fill(0);
+	cartridge->powerOn();
+	ppu.powerOn();
+	reset();
 }
 
 void Bus::clock()
 {
-	ppu.clock();
-	if (systemClockCounter % 3)
+	if constexpr (nes6502::tier == CpuAccuracy::CycleExact)
+	{
+		//the cpu drives the ppu through cpuTick, one call runs a whole instruction
 		cpu.clock();
-	if (ppu.nmi)
+		apuClock();
+	}
+	else
 	{
-		ppu.nmi = false;
+		if (ppuThread)
+			threadNmi |= ppuThread->dot(systemClockCounter);
+		else
+			ppu.clock();
+		if (systemClockCounter % 3 == 0)
+		{
+			cpu.clock();
+			apuClock();
+		}
+		systemClockCounter++;
+	}
+
+	bool& nmi = ppuThread ? threadNmi : ppu.nmi;
+	if (nmi)
+	{
+		nmi = false;
 		cpu.nmi();
 	}
-	systemClockCounter++;
+}
+
+void Bus::apuClock()
+{
+	//the apu only runs when it has something due, see nes2a03.h
+	if (systemClockCounter >= apuDue)
+	{
+		apu.run(systemClockCounter / 3);
+		apuDue = (size_t)apu.nextEvent() * 3;
+	}
+	//irq is a level, it is taken on the first instruction boundary with I clear
+	if (apu.irq() && cpu.cycles == 0)
+		cpu.irq();
+}
+
+void Bus::runFrame()
+{
+	beginFrame();
+	while (!frameComplete())
+		clock();
+}
+
+void Bus::beginFrame()
+{
+	if (ppuThread)
+		frameEndsAt = (size_t)ppuThread->frameEnd(systemClockCounter);
+	else
+		ppu.frame_complete = false;
+}
+
+bool Bus::frameComplete()
+{
+	if (!ppuThread)
+		return ppu.frame_complete;
+	if (systemClockCounter < frameEndsAt)
+		return false;
+	//the frame is handed over whole, so the ppu can be used directly until the next one starts
+	syncPpu();
+	return true;
+}
+
+void Bus::setPpuThread(bool enabled)
+{
+	if (enabled == (ppuThread != nullptr))
+		return;
+	if (enabled)
+	{
+		ppuThread = std::make_unique<PpuThread>(ppu, systemClockCounter);
+		threadNmi = false;
+	}
+	else
+	{
+		//nmi was delivered from the prediction, whatever the ppu flagged meanwhile is stale
+		syncPpu();
+		ppuThread.reset();
+		ppu.nmi = false;
+	}
+}
+
+void Bus::syncPpu() const
+{
+	if (ppuThread)
+		ppuThread->sync(systemClockCounter);
+}
+
+namespace
+{
+	struct PadState
+	{
+		uint8_t shift[2];
+		uint8_t strobe;
+	};
+}
+
+void Bus::saveMachine(StateWriter& writer) const
+{
+	syncPpu();
+	uint64_t clockCounter = systemClockCounter;
+	writer.write("BUS ", 1, clockCounter);
+	writer.write("RAM ", 1, cpuRam);
+	writer.write("PAD ", 1, PadState{ { controllerShift[0], controllerShift[1] }, controllerStrobe });
+	cpu.saveState(writer);
+	ppu.saveState(writer);
+	apu.saveState(writer);
+}
+
+bool Bus::loadMachine(const StateReader& reader)
+{
+	syncPpu();
+	uint64_t clockCounter = 0;
+	if (!reader.read("BUS ", 1, clockCounter) || !reader.read("RAM ", 1, cpuRam))
+		return false;
+	bool loaded = cpu.loadState(reader) && ppu.loadState(reader) && apu.loadState(reader);
+	//the ppu may have changed whether it loaded or not
+	if (ppuThread)
+		ppuThread->rebase(loaded ? clockCounter : systemClockCounter);
+	if (!loaded)
+		return false;
+
+	//states saved before the pads existed don't have them, the pads start unlatched
+	PadState pads = {};
+	if (reader.contains("PAD ") && !reader.read("PAD ", 1, pads))
+		return false;
+	controllerShift[0] = pads.shift[0];
+	controllerShift[1] = pads.shift[1];
+	controllerStrobe = pads.strobe != 0;
+	apuDue = 0;
+
+	systemClockCounter = (size_t)clockCounter;
+	return true;
+}
+
+void Bus::saveState(std::vector<uint8_t>& out) const
+{
+	StateWriter writer(out);
+	saveMachine(writer);
+	cartridge->saveState(writer);
+}
+
+bool Bus::loadState(const uint8_t* data, size_t size)
+{
+	StateReader reader(data, size);
+	touchAllBanks();
+	bool loaded = loadMachine(reader) && cartridge->loadState(reader);
+	ppu.chrReplaced();
+	return loaded;
+}
+
+std::unique_ptr<Bus> Bus::fork() const
+{
+	auto copy = std::make_unique<Bus>();
+	forkInto(*copy);
+	return copy;
+}
+
+void Bus::forkInto(Bus& target) const
+{
+	//the cartridge is left out of the scratch state, its memory is shared by the fork instead
+	thread_local std::vector<uint8_t> scratch;
+	StateWriter writer(scratch);
+	saveMachine(writer);
+
+	if (target.forkedCartridge)
+	{
+		target.syncPpu();
+		cartridge->forkInto(*target.cartridge);
+		//same object, but its chr and mirroring changed under the ppu
+		target.ppu.insertCartridge(target.cartridge);
+		target.touchAllBanks();
+	}
+	else
+	{
+		target.insertCartridge(cartridge->fork());
+		target.forkedCartridge = true;
+	}
+	target.loadMachine(StateReader(scratch.data(), scratch.size()));
+	target.controller[0] = controller[0];
+	target.controller[1] = controller[1];
+}
+
+void Bus::cpuTick()
+{
+	for (int i = 0; i < 3; i++)
+	{
+		if (ppuThread)
+			threadNmi |= ppuThread->dot(systemClockCounter);
+		else
+			ppu.clock();
+		systemClockCounter++;
+	}
 }
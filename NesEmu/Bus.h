@@ -2,34 +2,158 @@
 
 #include <array>
 #include <memory>
+#include <vector>
 
 #include "nes6502.h"
 #include "nes2c02.h"
+#include "nes2a03.h"
 #include "Cartridge.h"
+#include "Profiler.h"
+
+class StateWriter;
+class StateReader;
+class PpuThread;
+
+//Inline bytes one machine may take, everything it owns that is not rom or an optional buffer.
+//The optional heap buffers on top of it are the ppu framebuffer (256 * 240 bytes, only while
+//rendering), the fallback pattern tables (8 KB, only for cartridges without chr mapping) and the
+//deferred renderer's two frame logs (~150 KB, only when the ppu is switched to it).
+constexpr size_t BUS_BYTE_BUDGET = 5 * 1024;
 
 class Bus
 {
+	//hot state first: cpu registers, ram and the ppu registers/vram/oam form one block
 public:
 	nes6502 cpu;
-	nes2c02 ppu;
 
 private:
 	std::array<uint8_t, 2048> cpuRam;
-	std::shared_ptr<Cartridge> cartridge;
 	size_t systemClockCounter = 0;
 
 public:
-	Bus()
-		:cpu(this)
+	nes2c02 ppu;
+	nes2a03 apu;
+
+	//host side pad state, one bit per button: A B Select Start Up Down Left Right from bit 0
+	uint8_t controller[2] = {};
+
+private:
+	//the pads' shift registers, reloaded from controller[] while the strobe ($4016 bit 0) is high
+	uint8_t controllerShift[2] = {};
+	bool controllerStrobe = false;
+	//ppu dot the apu next has to run on, nextEvent() cached so the clock doesn't ask every dot
+	size_t apuDue = 0;
+	//the cartridge was made by forkInto() and is this machine's alone, the next forkInto() reuses it
+	bool forkedCartridge = false;
+	//with a ppu thread nmi comes from its prediction, the ppu's own flag belongs to the other thread
+	bool threadNmi = false;
+	//clock counter the frame runFrame() waits for ends at, with a ppu thread
+	size_t frameEndsAt = 0;
+
+public:
+
+	//debugger write watch: cpu writes to writeWatch (ram mirrors folded to $0000-$07FF) set watchHit, -1 is off
+	int32_t writeWatch = -1;
+	bool watchHit = false;
+
+private:
+	std::shared_ptr<Cartridge> cartridge;
+	//set while the ppu runs on a thread of its own, see setPpuThread()
+	std::unique_ptr<PpuThread> ppuThread;
+#ifdef NES_PROFILE
+	Profiler* profiler = nullptr;
+#endif
+	//bumped by every cpu write that can change what a 4 KB bank of the cpu address space holds:
+	//ram, cartridge ram, or a mapper register, which may switch any prg bank
+	uint32_t bankVersion[16] = {};
+
+	void touchAllBanks();
+	//ppu dots run when the cpu accesses the bus: the fast cpu runs after the dot of its bus clock,
+	//the cycle-exact one before the dots of its cycle
+	size_t ppuTime() const { return systemClockCounter + (nes6502::tier == CpuAccuracy::Fast ? 1 : 0); }
+
+	void countAccess([[maybe_unused]] Profiler::Region region, [[maybe_unused]] bool write)
 	{
-		cpuRam.fill(0);
+#ifdef NES_PROFILE
+		if (profiler)
+			write ? profiler->write(region) : profiler->read(region);
+#endif
 	}
 
+	//after every cpu cycle or instruction: runs the apu when due and raises its irq
+	void apuClock();
+	void saveMachine(StateWriter& writer) const;
+	bool loadMachine(const StateReader& reader);
+
+public:
+	Bus();
+	~Bus();
+
 	void cpuWrite(uint16_t addr, uint8_t data);
 	uint8_t cpuRead(uint16_t addr);
 
 	void insertCartridge(std::shared_ptr<Cartridge> cartridge);
 	void reset();
+	//a reset that also clears every memory reset() keeps: cpu ram, ppu memory, prg ram and chr ram.
+	//Whatever ran before leaves nothing behind, so a run from here only depends on the rom and inputs
+	void powerOn();
 	void clock();
+	//clocks until the ppu finishes the frame it is drawing
+	void runFrame();
+	//the same for callers that clock themselves: call beginFrame(), then clock() until frameComplete()
+	void beginFrame();
+	bool frameComplete();
+
+	//Runs the ppu on a thread of its own, fed the register accesses in order (see PpuThread.h), so
+	//cpu and ppu overlap. The result is the same dot for dot. Outside of the bus the ppu may only be
+	//used between frames, or after syncPpu() when clocking by hand.
+	void setPpuThread(bool enabled);
+	bool hasPpuThread() const { return ppuThread != nullptr; }
+	//waits for the ppu thread to catch up with the cpu, does nothing without one
+	void syncPpu() const;
+
+	//Counts what the cpu runs and every access through cpuRead/cpuWrite, see Profiler.h. Only
+	//builds with NES_PROFILE keep it, otherwise nothing is attached and getProfiler() is nullptr.
+	void setProfiler([[maybe_unused]] Profiler* profiler)
+	{
+#ifdef NES_PROFILE
+		this->profiler = profiler;
+#endif
+	}
+	Profiler* getProfiler() const
+	{
+#ifdef NES_PROFILE
+		return profiler;
+#else
+		return nullptr;
+#endif
+	}
+
+	//runs the ppu for one cpu cycle, called by the cycle-exact cpu on every bus access
+	void cpuTick();
+
+	//full machine snapshot, see SaveState.h for the format. out keeps its capacity between saves.
+	//A failed load can leave the machine half restored, reset or load another state after it.
+	void saveState(std::vector<uint8_t>& out) const;
+	bool loadState(const uint8_t* data, size_t size);
+	bool loadState(const std::vector<uint8_t>& data) { return loadState(data.data(), data.size()); }
+
+	//Independent machine in the same state. The registers, ram and ppu memory (~4.5 KB) are copied
+	//right away, the rom is shared and cartridge memory is copied a page at a time on first write.
+	std::unique_ptr<Bus> fork() const;
+	//Same as fork but into an existing machine. From the second fork into the same target on, its
+	//cartridge is reused too, so the fork allocates nothing, only pages written afterwards are copied.
+	void forkInto(Bus& target) const;
+
+	const std::array<uint8_t, 2048>& getRam() const { return cpuRam; }
+	const std::shared_ptr<Cartridge>& getCartridge() const { return cartridge; }
+	//ppu dots since reset, the position debugger checkpoints and input logs are keyed on
+	size_t getClockCounter() const { return systemClockCounter; }
+	//the next clock starts an instruction. The fast cpu only clocks on every third dot, between
+	//those it sits at cycles == 0 without moving
+	bool atInstructionBoundary() const { return cpu.cycles == 0 && (nes6502::tier == CpuAccuracy::CycleExact || systemClockCounter % 3 == 0); }
+	//a bank whose version moved has to be disassembled again
+	uint32_t getBankVersion(uint16_t addr) const { return bankVersion[addr >> 12]; }
 };
 
+static_assert(sizeof(Bus) <= BUS_BYTE_BUDGET, "a machine outgrew its per-instance byte budget");
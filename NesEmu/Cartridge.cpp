@@ -1,8 +1,10 @@
 #include "Cartridge.h"
 #include "Mapper.h"
+#include "SaveState.h"
 
 #include <iostream>
 #include <fstream>
+#include <algorithm>
 
 #include "Mapper_000.h"
 
@@ -25,7 +27,7 @@ Cartridge::Cartridge(std::string filePath)
 	if (file.fail())
 	{
 		m_imageValid = false;
-		std::cout << "[ERROR] File with path '" << filePath << "' does not exist." << std::endl;
+		std::cerr << "[ERROR] File with path '" << filePath << "' does not exist." << std::endl;
 		return;
 	}
 
@@ -38,12 +40,15 @@ Cartridge::Cartridge(std::string filePath)
 	this->mirror = (header.flags6 & 0x01) ? VERTICAL : HORIZONTAL;
 
 	this->nPRGBank = header.nPRGRom;
-	this->memPRG.resize((size_t)nPRGBank * 16384);
-	file.read((char*)memPRG.data(), memPRG.size());
+	auto prg = std::make_shared<std::vector<uint8_t>>((size_t)nPRGBank * 16384);
+	file.read((char*)prg->data(), prg->size());
+	this->memPRG = prg;
 
 	this->nCHRBank = header.nCHRRom;
-	this->memCHR.resize((size_t)(nCHRBank == 0 ? 1 : nCHRBank) * 8192);
-	file.read((char*)memCHR.data(), memCHR.size());
+	std::vector<uint8_t> chr((size_t)(nCHRBank == 0 ? 1 : nCHRBank) * 8192);
+	file.read((char*)chr.data(), chr.size());
+	this->memCHR = CowMemory(chr.size());
+	this->memCHR.copyFrom(chr.data());
 
 	switch (this->mapperID)
 	{
@@ -52,12 +57,12 @@ Cartridge::Cartridge(std::string filePath)
 		break;
 	default:
 		this->mapper = nullptr;
-		std::cout << "[ERROR] Mapper_" << (int)mapperID << " is not added to the emulator." << std::endl;
+		std::cerr << "[ERROR] Mapper_" << (int)mapperID << " is not added to the emulator." << std::endl;
 		break;
 	}
 
 
-	this->m_imageValid = true;
+	this->m_imageValid = mapper != nullptr;
 	file.close();
 }
 
@@ -65,12 +70,16 @@ bool Cartridge::cpuWrite(uint16_t addr, uint8_t data)
 {
 	uint32_t mapped_addr = 0;
 
-	if (mapper->cpuMapWrite(addr, mapped_addr))
+	if (addr >= 0x6000 && addr <= 0x7FFF)
 	{
-		memPRG[mapped_addr] = data;
+		prgRam.write(addr & 0x1FFF, data);
 		return true;
 	}
 
+	//prg is rom, the write still belongs to the cartridge but changes nothing
+	if (mapper->cpuMapWrite(addr, mapped_addr))
+		return true;
+
 	return false;
 }
 
@@ -78,22 +87,35 @@ bool Cartridge::cpuRead(uint16_t addr, uint8_t& data)
 {
 	uint32_t mapped_addr = 0;
 
+	if (addr >= 0x6000 && addr <= 0x7FFF)
+	{
+		data = prgRam.read(addr & 0x1FFF);
+		return true;
+	}
+
 	if (mapper->cpuMapRead(addr, mapped_addr))
 	{
-		data = memPRG[mapped_addr];
+		data = (*memPRG)[mapped_addr];
 		return true;
 	}
 
 	return false;
 }
 
+bool Cartridge::prgOffset(uint16_t addr, uint32_t& offset) const
+{
+	if (addr >= 0x6000 && addr <= 0x7FFF)
+		return false;
+	return mapper->cpuMapRead(addr, offset) && offset < memPRG->size();
+}
+
 bool Cartridge::ppuWrite(uint16_t addr, uint8_t data)
 {
 	uint32_t mapped_addr = 0;
 
 	if (mapper->ppuMapWrite(addr, mapped_addr))
 	{
-		memCHR[mapped_addr] = data;
+		memCHR.write(mapped_addr, data);
 		return true;
 	}
 
@@ -106,7 +128,7 @@ bool Cartridge::ppuRead(uint16_t addr, uint8_t& data)
 
 	if (mapper->ppuMapRead(addr, mapped_addr))
 	{
-		data = memCHR[mapped_addr];
+		data = memCHR.read(mapped_addr);
 		return true;
 	}
 
@@ -118,3 +140,66 @@ void Cartridge::reset()
 	if (mapper != nullptr)
 		mapper->reset();
 }
+
+void Cartridge::powerOn()
+{
+	std::vector<uint8_t> zeros(std::max(prgRam.size(), memCHR.size()), 0);
+	prgRam.copyFrom(zeros.data());
+	if (hasChrRam())
+		memCHR.copyFrom(zeros.data());
+	reset();
+}
+
+void Cartridge::saveState(StateWriter& writer) const
+{
+	prgRam.copyTo(writer.reserveChunk("PRAM", 1, (uint32_t)prgRam.size()));
+	if (nCHRBank == 0)
+		memCHR.copyTo(writer.reserveChunk("CHR ", 1, (uint32_t)memCHR.size()));
+	if (mapper != nullptr)
+		mapper->saveState(writer);
+}
+
+bool Cartridge::loadState(const StateReader& reader)
+{
+	//states saved before prg ram existed don't have it, the ram is left as it is
+	if (reader.contains("PRAM"))
+	{
+		const uint8_t* ram = reader.chunkData("PRAM", 1, (uint32_t)prgRam.size());
+		if (ram == nullptr)
+			return false;
+		prgRam.copyFrom(ram);
+	}
+
+	if (nCHRBank == 0)
+	{
+		const uint8_t* chr = reader.chunkData("CHR ", 1, (uint32_t)memCHR.size());
+		if (chr == nullptr)
+			return false;
+		memCHR.copyFrom(chr);
+	}
+	return mapper == nullptr || mapper->loadState(reader);
+}
+
+std::shared_ptr<Cartridge> Cartridge::fork() const
+{
+	auto copy = std::make_shared<Cartridge>(*this);
+	if (mapper != nullptr)
+		copy->mapper = mapper->clone();
+	return copy;
+}
+
+void Cartridge::forkInto(Cartridge& target) const
+{
+	std::shared_ptr<Mapper> kept = target.mapperID == mapperID ? std::move(target.mapper) : nullptr;
+	//the page tables are assigned over the target's, which keeps their capacity
+	target = *this;
+	if (mapper == nullptr)
+		return;
+	if (kept != nullptr)
+	{
+		kept->copyFrom(*mapper);
+		target.mapper = std::move(kept);
+	}
+	else
+		target.mapper = mapper->clone();
+}
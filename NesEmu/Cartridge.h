@@ -4,14 +4,21 @@
 #include <vector>
 #include <string>
 
+#include "CowMemory.h"
+
 class Mapper;
+class StateWriter;
+class StateReader;
 
 class Cartridge
 {
-public:
-	std::vector<uint8_t> memPRG;
-	std::vector<uint8_t> memCHR;
 private:
+	//rom never changes after loading, every fork of a cartridge points at the same bytes
+	std::shared_ptr<const std::vector<uint8_t>> memPRG;
+	CowMemory memCHR;
+	//8 KB at $6000-$7FFF, also where blargg's test roms report their result
+	CowMemory prgRam = CowMemory(8192);
+
 	std::shared_ptr<Mapper> mapper;
 
 	uint8_t mapperID = 0;
@@ -37,7 +44,23 @@ public:
 	bool ppuRead(uint16_t addr, uint8_t& data);
 
 	void reset();
+	//reset() keeps prg ram and chr ram, this also clears them to how a loaded image starts
+	void powerOn();
+
+	//only the writable parts: prg ram, chr ram and mapper registers, rom is never saved
+	void saveState(StateWriter& writer) const;
+	bool loadState(const StateReader& reader);
 
 	bool imageValid() { return m_imageValid; }
+	//no chr rom in the image, the 8 KB at $0000-$1FFF are ram the ppu can write
+	bool hasChrRam() const { return nCHRBank == 0; }
+	std::shared_ptr<const std::vector<uint8_t>> getPRG() const { return memPRG; }
+	//offset into the prg rom that addr reads under the current banks, false for anything else
+	bool prgOffset(uint16_t addr, uint32_t& offset) const;
+
+	//copy that shares the rom and the untouched chr pages with this one
+	std::shared_ptr<Cartridge> fork() const;
+	//the same into an existing cartridge: page tables and a mapper of the same kind are reused
+	void forkInto(Cartridge& target) const;
 };
 
@@ -0,0 +1,178 @@
+#include "CodeMap.h"
+#include "Cartridge.h"
+#include "Disassembly.h"
+#include "ThreadPool.h"
+#include "nes6502.h"
+
+int64_t CodeMap::offset(uint16_t addr) const
+{
+	int64_t base = pageBase[addr >> 12];
+	return base < 0 ? -1 : base + (addr & 0x0FFF);
+}
+
+void CodeMap::analyzeBank(size_t bank, std::vector<Seed>& seeds, Outgoing& out)
+{
+	Bank& map = banks[bank];
+	const std::vector<uint8_t>& rom = *prg;
+
+	//entry points outside rom are dropped, ones in other banks are passed on
+	auto follow = [&](uint16_t addr, bool block, bool target)
+	{
+		int64_t at = offset(addr);
+		if (at < 0)
+			return;
+		if (size_t(at) / BANK_SIZE == bank)
+			seeds.push_back({ addr, block, target });
+		else
+			out.seeds.push_back({ addr, block, target });
+	};
+
+	while (!seeds.empty())
+	{
+		Seed seed = seeds.back();
+		seeds.pop_back();
+
+		size_t local = size_t(offset(seed.addr)) % BANK_SIZE;
+		if (seed.block)
+			map.blockStart[local] = true;
+		if (seed.target)
+			map.jumpTarget[local] = true;
+
+		//run the straight line from the entry point until control leaves it or joins known code
+		uint16_t addr = seed.addr;
+		while (true)
+		{
+			int64_t at = offset(addr);
+			if (at < 0 || size_t(at) / BANK_SIZE != bank)
+			{
+				follow(addr, false, false);
+				break;
+			}
+
+			local = size_t(at) % BANK_SIZE;
+			if (map.instruction[local])
+				break;
+
+			uint8_t opcode = rom[at];
+			if (nes6502::opcodeName(opcode) == "???")
+				break;
+
+			uint8_t length = Disassembly::instructionLength(opcode);
+			map.instruction[local] = true;
+			for (uint8_t i = 0; i < length; i++)
+			{
+				int64_t byte = offset(uint16_t(addr + i));
+				if (byte >= 0 && size_t(byte) / BANK_SIZE == bank)
+					map.code[size_t(byte) % BANK_SIZE] = true;
+				else if (byte >= 0)
+					out.operands.push_back(uint32_t(byte));
+			}
+
+			auto operand = [&](int i) { int64_t byte = offset(uint16_t(addr + i)); return byte < 0 ? uint8_t(0) : rom[byte]; };
+			uint16_t next = uint16_t(addr + length);
+			uint16_t absolute = uint16_t(operand(1) | (operand(2) << 8));
+
+			if (nes6502::addressMode(opcode) == AddressMode::REL)
+			{
+				follow(uint16_t(next + int8_t(operand(1))), true, true);
+				follow(next, true, false);
+				break;
+			}
+			else if (opcode == 0x20)
+			{
+				//JSR, assumed to come back
+				follow(absolute, true, true);
+				follow(next, true, false);
+				break;
+			}
+			else if (opcode == 0x4C)
+			{
+				follow(absolute, true, true);
+				break;
+			}
+			else if (opcode == 0x6C)
+			{
+				//JMP ($xxxx) can only be followed when the pointer is in rom, with the page wrap of the real cpu
+				int64_t lo = offset(absolute);
+				int64_t hi = offset(uint16_t((absolute & 0xFF00) | ((absolute + 1) & 0x00FF)));
+				if (lo >= 0 && hi >= 0)
+					follow(uint16_t(rom[lo] | (rom[hi] << 8)), true, true);
+				break;
+			}
+			else if (opcode == 0x60 || opcode == 0x40 || opcode == 0x00)
+			{
+				//RTS, RTI, BRK
+				break;
+			}
+			addr = next;
+		}
+	}
+}
+
+void CodeMap::analyze(const Cartridge& cartridge, ThreadPool& pool)
+{
+	prg = cartridge.getPRG();
+	banks.assign((prg->size() + BANK_SIZE - 1) / BANK_SIZE, Bank());
+	for (int page = 0; page < 16; page++)
+	{
+		uint32_t base = 0;
+		pageBase[page] = cartridge.prgOffset(uint16_t(page << 12), base) ? int64_t(base) : -1;
+	}
+
+	std::vector<std::vector<Seed>> seeds(banks.size());
+	std::vector<Outgoing> outgoing(banks.size());
+
+	//NMI, reset and IRQ/BRK
+	for (uint16_t vector : { 0xFFFA, 0xFFFC, 0xFFFE })
+	{
+		int64_t lo = offset(vector), hi = offset(uint16_t(vector + 1));
+		if (lo < 0 || hi < 0)
+			continue;
+		uint16_t addr = uint16_t((*prg)[lo] | ((*prg)[hi] << 8));
+		int64_t at = offset(addr);
+		if (at >= 0)
+			seeds[size_t(at) / BANK_SIZE].push_back({ addr, true, true });
+	}
+
+	bool pending = true;
+	while (pending)
+	{
+		for (size_t bank = 0; bank < banks.size(); bank++)
+		{
+			if (!seeds[bank].empty())
+				pool.submit([this, bank, &seeds, &outgoing] { analyzeBank(bank, seeds[bank], outgoing[bank]); });
+		}
+		pool.wait();
+
+		//hand what crossed a bank boundary to its bank, only between rounds so no job writes another's maps
+		pending = false;
+		for (Outgoing& out : outgoing)
+		{
+			for (const Seed& seed : out.seeds)
+			{
+				seeds[size_t(offset(seed.addr)) / BANK_SIZE].push_back(seed);
+				pending = true;
+			}
+			for (uint32_t byte : out.operands)
+				banks[byte / BANK_SIZE].code[byte % BANK_SIZE] = true;
+			out.seeds.clear();
+			out.operands.clear();
+		}
+	}
+}
+
+size_t CodeMap::instructionCount() const
+{
+	size_t count = 0;
+	for (const Bank& bank : banks)
+		count += bank.instruction.count();
+	return count;
+}
+
+size_t CodeMap::blockCount() const
+{
+	size_t count = 0;
+	for (const Bank& bank : banks)
+		count += bank.blockStart.count();
+	return count;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <bitset>
+#include <cinttypes>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+class Cartridge;
+class ThreadPool;
+
+//Which prg rom bytes are code, found by following the program from the reset, NMI and IRQ vectors.
+//Branches, JSR and JMP are followed (JMP ($xxxx) too when the pointer is in rom); RTS, RTI, BRK and
+//unknown opcodes end a path. Everything never reached is taken as data, which linear sweeping
+//can't tell apart from code.
+//The result is four bitmaps per 4 KB bank of prg rom, keyed by prg offset so they stay valid
+//whatever is banked in. Each round analyzes every bank with pending entry points as its own pool
+//job; paths that leave a bank are handed to that bank for the next round.
+//Cpu addresses are resolved with the banks mapped when analyze() runs, code only reachable
+//through another bank configuration is not found.
+class CodeMap
+{
+public:
+	static constexpr size_t BANK_SIZE = 0x1000;
+
+	struct Bank
+	{
+		//first byte of a decoded instruction
+		std::bitset<BANK_SIZE> instruction;
+		//any byte of one
+		std::bitset<BANK_SIZE> code;
+		//first instruction of a basic block: entry points, jump targets and what follows a branch or JSR
+		std::bitset<BANK_SIZE> blockStart;
+		//target of a branch, jump, call or vector
+		std::bitset<BANK_SIZE> jumpTarget;
+	};
+
+private:
+	struct Seed
+	{
+		uint16_t addr;
+		bool block, target;
+	};
+
+	//what one bank job hands back: entry points in other banks and operand bytes that spill into them
+	struct Outgoing
+	{
+		std::vector<Seed> seeds;
+		std::vector<uint32_t> operands;
+	};
+
+	std::shared_ptr<const std::vector<uint8_t>> prg;
+	//prg offset of each 4 KB cpu page, -1 where no rom is mapped
+	int64_t pageBase[16] = {};
+	std::vector<Bank> banks;
+
+	int64_t offset(uint16_t addr) const;
+	void analyzeBank(size_t bank, std::vector<Seed>& seeds, Outgoing& out);
+
+public:
+	void analyze(const Cartridge& cartridge, ThreadPool& pool);
+
+	bool analyzed() const { return !banks.empty(); }
+	size_t bankCount() const { return banks.size(); }
+	const Bank& bank(size_t index) const { return banks[index]; }
+
+	bool isInstruction(uint32_t prgOffset) const { return test(&Bank::instruction, prgOffset); }
+	bool isCode(uint32_t prgOffset) const { return test(&Bank::code, prgOffset); }
+	bool isBlockStart(uint32_t prgOffset) const { return test(&Bank::blockStart, prgOffset); }
+	bool isJumpTarget(uint32_t prgOffset) const { return test(&Bank::jumpTarget, prgOffset); }
+
+	size_t instructionCount() const;
+	size_t blockCount() const;
+
+private:
+	bool test(std::bitset<BANK_SIZE> Bank::* map, uint32_t prgOffset) const
+	{
+		return prgOffset / BANK_SIZE < banks.size() && (banks[prgOffset / BANK_SIZE].*map)[prgOffset % BANK_SIZE];
+	}
+};
@@ -19,4 +19,14 @@ std::string hex(uint16_t num)
 		num /= 16;
 	}
 	return str;
-}
\ No newline at end of file
+}
+uint64_t fnv1a(const uint8_t* data, size_t size, uint64_t seed)
+{
+	uint64_t h = seed;
+	for (size_t i = 0; i < size; i++)
+	{
+		h ^= data[i];
+		h *= 0x100000001B3ull;
+	}
+	return h;
+}
@@ -4,4 +4,7 @@
 #include <cinttypes>
 
 std::string hex(uint8_t num);
-std::string hex(uint16_t num);
\ No newline at end of file
+std::string hex(uint16_t num);
+
+//FNV-1a, used to compare ram and frames between runs
+uint64_t fnv1a(const uint8_t* data, size_t size, uint64_t seed = 0xCBF29CE484222325ull);
@@ -0,0 +1,47 @@
+#include "CowMemory.h"
+
+#include <cstring>
+#include <algorithm>
+
+CowMemory::CowMemory(size_t size)
+	: m_size(size)
+{
+	size_t count = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+	pages.resize(count);
+	view.resize(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		pages[i] = std::shared_ptr<uint8_t[]>(new uint8_t[PAGE_SIZE]());
+		view[i] = pages[i].get();
+	}
+}
+
+void CowMemory::detach(size_t page)
+{
+	std::shared_ptr<uint8_t[]> copy(new uint8_t[PAGE_SIZE]);
+	std::memcpy(copy.get(), view[page], PAGE_SIZE);
+	pages[page] = std::move(copy);
+	view[page] = pages[page].get();
+}
+
+void CowMemory::copyTo(uint8_t* dst) const
+{
+	for (size_t i = 0; i < view.size(); i++)
+	{
+		size_t len = std::min(PAGE_SIZE, m_size - i * PAGE_SIZE);
+		std::memcpy(dst + i * PAGE_SIZE, view[i], len);
+	}
+}
+
+void CowMemory::copyFrom(const uint8_t* src)
+{
+	for (size_t i = 0; i < view.size(); i++)
+	{
+		size_t len = std::min(PAGE_SIZE, m_size - i * PAGE_SIZE);
+		if (std::memcmp(view[i], src + i * PAGE_SIZE, len) == 0)
+			continue;
+		if (pages[i].use_count() > 1)
+			detach(i);
+		std::memcpy(view[i], src + i * PAGE_SIZE, len);
+	}
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <cinttypes>
+
+//Byte array split into 1 KB pages. Copies share every page until one of them writes to it,
+//then only that page is duplicated, so a forked machine never copies memory it doesn't touch.
+//Copying is not synchronized with writes, only copy a memory that isn't being written.
+class CowMemory
+{
+public:
+	static constexpr size_t PAGE_SIZE = 1024;
+
+private:
+	std::vector<std::shared_ptr<uint8_t[]>> pages;
+	//raw page pointers so reads skip the shared_ptr
+	std::vector<uint8_t*> view;
+	size_t m_size = 0;
+
+	void detach(size_t page);
+
+public:
+	CowMemory() {}
+	CowMemory(size_t size);
+
+	size_t size() const { return m_size; }
+
+	uint8_t read(size_t addr) const
+	{
+		return view[addr / PAGE_SIZE][addr % PAGE_SIZE];
+	}
+
+	void write(size_t addr, uint8_t data)
+	{
+		size_t page = addr / PAGE_SIZE;
+		if (pages[page].use_count() > 1)
+			detach(page);
+		view[page][addr % PAGE_SIZE] = data;
+	}
+
+	void copyTo(uint8_t* dst) const;
+	//pages whose content is already equal stay shared
+	void copyFrom(const uint8_t* src);
+};
@@ -0,0 +1,196 @@
+#include "Disassembly.h"
+#include "Bus.h"
+#include "Cartridge.h"
+#include "CodeMap.h"
+#include "Common.h"
+
+#include <algorithm>
+
+Disassembly::Disassembly(Bus& bus)
+	: bus(bus), lengths(0x10000, 0)
+{}
+
+void Disassembly::setCodeMap(const CodeMap* map)
+{
+	codeMap = map;
+	std::fill(std::begin(built), std::end(built), false);
+}
+
+uint8_t Disassembly::instructionLength(uint8_t opcode)
+{
+	switch (nes6502::addressMode(opcode))
+	{
+	case AddressMode::IMP:
+	case AddressMode::ACC:
+		return 1;
+	case AddressMode::ABS:
+	case AddressMode::ABX:
+	case AddressMode::ABY:
+	case AddressMode::IND:
+		return 3;
+	default:
+		return 2;
+	}
+}
+
+uint8_t Disassembly::peek(uint16_t addr) const
+{
+	//past the bus, so the debugger's reads don't show up in its profile
+	uint8_t data = 0;
+	if (bus.getCartridge()->cpuRead(addr, data))
+		return data;
+	if (addr <= 0x1FFF)
+		return bus.getRam()[addr & 0x07FF];
+	return 0;
+}
+
+void Disassembly::ensure(uint16_t addr)
+{
+	int bank = addr >> BANK_SHIFT;
+	if (built[bank] && versions[bank] == bus.getBankVersion(addr))
+		return;
+
+	//carry on from the bank before when it is known, so an instruction across the boundary isn't cut
+	uint16_t start = uint16_t(bank << BANK_SHIFT);
+	if (bank > 0 && built[bank - 1] && versions[bank - 1] == bus.getBankVersion(start - 1))
+	{
+		for (uint16_t a = start - 3; a != start; a++)
+		{
+			if (lengths[a] != 0 && a + size(a) > start)
+				start = uint16_t(a + size(a));
+		}
+	}
+
+	std::fill(lengths.begin() + (bank << BANK_SHIFT), lengths.begin() + ((bank + 1) << BANK_SHIFT), 0);
+	built[bank] = true;
+	versions[bank] = bus.getBankVersion(addr);
+	sweep(start, false);
+}
+
+void Disassembly::sweep(uint16_t start, bool anchor)
+{
+	int bank = start >> BANK_SHIFT;
+	uint32_t end = uint32_t(bank + 1) << BANK_SHIFT;
+	const Cartridge& cartridge = *bus.getCartridge();
+	//an anchored sweep decodes from start as code until it runs into code the map knows
+	bool linear = anchor;
+	for (uint32_t a = start; a < end; a += size(uint16_t(a)))
+	{
+		uint32_t offset = 0;
+		bool mapped = codeMap != nullptr && codeMap->analyzed() && cartridge.prgOffset(uint16_t(a), offset);
+		if (mapped && codeMap->isInstruction(offset))
+			linear = false;
+
+		if (mapped && !linear && !codeMap->isInstruction(offset))
+			lengths[a] = 1 | DATA;
+		else
+			lengths[a] = instructionLength(peek(uint16_t(a)));
+		//anything the new instruction covers is no longer a start
+		for (uint32_t b = a + 1; b < a + size(uint16_t(a)) && b < end; b++)
+			lengths[b] = 0;
+	}
+}
+
+uint16_t Disassembly::previous(uint16_t addr)
+{
+	//an instruction ending exactly at addr first, else whatever starts closest before it
+	uint16_t fallback = uint16_t(addr - 1);
+	bool found = false;
+	for (int back = 1; back <= 3; back++)
+	{
+		uint16_t a = uint16_t(addr - back);
+		ensure(a);
+		if (lengths[a] != 0 && size(a) == back)
+			return a;
+		if (lengths[a] != 0 && !found)
+		{
+			fallback = a;
+			found = true;
+		}
+	}
+	return fallback;
+}
+
+uint16_t Disassembly::next(uint16_t addr)
+{
+	for (int i = 0; i < 3; i++)
+	{
+		uint16_t a = uint16_t(addr + i);
+		ensure(a);
+		if (lengths[a] != 0)
+			return a;
+	}
+	return addr;
+}
+
+size_t Disassembly::window(uint16_t address, size_t before, Line* out, size_t count)
+{
+	if (count == 0)
+		return 0;
+
+	ensure(address);
+	//the sweep went through address inside an instruction or took it for data, restart it from there
+	if (lengths[address] == 0 || (lengths[address] & DATA))
+		sweep(address, true);
+
+	//walk back, never past address 0 or more than count - 1 lines
+	before = std::min(before, count - 1);
+	std::vector<uint16_t> starts;
+	uint16_t a = address;
+	while (starts.size() < before && a > 0)
+	{
+		a = previous(a);
+		starts.push_back(a);
+	}
+
+	size_t lines = 0;
+	for (auto it = starts.rbegin(); it != starts.rend(); ++it)
+	{
+		out[lines].address = *it;
+		out[lines++].data = (lengths[*it] & DATA) != 0;
+	}
+	for (uint32_t b = address; lines < count && b <= 0xFFFF; )
+	{
+		uint16_t at = uint16_t(b);
+		ensure(at);
+		out[lines].address = at;
+		out[lines++].data = (lengths[at] & DATA) != 0;
+		b += lengths[at] != 0 ? size(at) : instructionLength(peek(at));
+	}
+
+	for (size_t i = 0; i < lines; i++)
+	{
+		for (int j = 0; j < 3; j++)
+			out[i].bytes[j] = peek(uint16_t(out[i].address + j));
+	}
+	return lines;
+}
+
+std::string Disassembly::format(const Line& line)
+{
+	uint8_t opcode = line.bytes[0];
+	if (line.data)
+		return "0x" + hex(line.address) + ": .db $" + hex(opcode);
+
+	std::string lo = hex(line.bytes[1]);
+	std::string hi = hex(line.bytes[2]);
+	std::string text = "0x" + hex(line.address) + ": " + std::string(nes6502::opcodeName(opcode)) + "[" + hex(opcode) + "] ";
+
+	switch (nes6502::addressMode(opcode))
+	{
+	case AddressMode::IMP: break;
+	case AddressMode::ACC: text += "A"; break;
+	case AddressMode::IMM: text += "#$" + lo; break;
+	case AddressMode::ZP0: text += "*" + lo; break;
+	case AddressMode::ZPX: text += "*" + lo + ", X"; break;
+	case AddressMode::ZPY: text += "*" + lo + ", Y"; break;
+	case AddressMode::REL: text += lo; break;
+	case AddressMode::ABS: text += hi + lo; break;
+	case AddressMode::ABX: text += hi + lo + ", X"; break;
+	case AddressMode::ABY: text += hi + lo + ", Y"; break;
+	case AddressMode::IND: text += "(" + hi + lo + ")"; break;
+	case AddressMode::IZX: text += "(" + lo + ", X)"; break;
+	case AddressMode::IZY: text += "(" + lo + "), Y"; break;
+	}
+	return text;
+}
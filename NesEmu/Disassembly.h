@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cinttypes>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class Bus;
+class CodeMap;
+
+//Instruction boundaries of the whole cpu address space, for the debugger's code view.
+//The index is one length byte per address (0 = not the start of an instruction). A 4 KB bank is
+//swept linearly the first time it is needed and again whenever the bus reports a write that may
+//have changed it (Bus::getBankVersion), so nothing is decoded up front and a mapper switch or
+//self-modifying ram code only costs the banks that are looked at afterwards.
+//Text is never stored: format() makes one line from the bytes when it is drawn.
+//With a CodeMap, rom bytes the analysis never reached are shown as data instead of being decoded.
+class Disassembly
+{
+public:
+	static constexpr int BANK_SHIFT = 12;
+	static constexpr int BANKS = 0x10000 >> BANK_SHIFT;
+
+	struct Line
+	{
+		uint16_t address;
+		uint8_t bytes[3];
+		//a byte the code map says is never executed
+		bool data;
+	};
+
+private:
+	//set in lengths for a byte shown as data, the length is then 1
+	static constexpr uint8_t DATA = 0x80;
+
+	Bus& bus;
+	const CodeMap* codeMap = nullptr;
+	std::vector<uint8_t> lengths;
+	bool built[BANKS] = {};
+	uint32_t versions[BANKS] = {};
+
+	//reads without side effects, the ppu and apu registers read as 0
+	uint8_t peek(uint16_t addr) const;
+	void ensure(uint16_t addr);
+	uint8_t size(uint16_t addr) const { return lengths[addr] & ~DATA; }
+	//sweeps from start to the end of its bank, rom bytes the code map doesn't have as code become data.
+	//Anchored sweeps take start as code even so, and what follows it until they meet known code.
+	void sweep(uint16_t start, bool anchor);
+	uint16_t previous(uint16_t addr);
+
+public:
+	Disassembly(Bus& bus);
+
+	//the map has to outlive this, nullptr goes back to plain linear sweeping
+	void setCodeMap(const CodeMap* map);
+
+	static uint8_t instructionLength(uint8_t opcode);
+	//"0xC000: JMP[4C] F5C5", the same text the old full dump produced
+	static std::string format(const Line& line);
+
+	//up to count lines: up to before instructions ahead of address, the one at address, then the ones after it.
+	//address becomes an instruction start if the sweep had it inside another instruction.
+	//Returns the number of lines, the one at address is at index min(before, instructions found before it).
+	size_t window(uint16_t address, size_t before, Line* out, size_t count);
+	//the instruction starting at addr or the first one after it
+	uint16_t next(uint16_t addr);
+};
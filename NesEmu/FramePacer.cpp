@@ -0,0 +1,87 @@
+#include "FramePacer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <SFML/System.hpp>
+
+namespace
+{
+	constexpr auto MIN_SPIN = std::chrono::microseconds(250);
+	constexpr auto MAX_SPIN = std::chrono::milliseconds(4);
+}
+
+FramePacer::FramePacer(double rate)
+	: period(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / rate)))
+{
+	reset();
+}
+
+void FramePacer::reset()
+{
+	deadline = last = Clock::now();
+	frames = 0;
+	late = 0;
+}
+
+void FramePacer::setUnlimited(bool enabled)
+{
+	if (unlimited != enabled)
+	{
+		unlimited = enabled;
+		deadline = Clock::now();
+	}
+}
+
+void FramePacer::wait()
+{
+	if (!unlimited)
+	{
+		deadline += period;
+		Clock::time_point now = Clock::now();
+		if (deadline < now - period)
+			deadline = now;
+		else
+		{
+			//sf::sleep rather than std::this_thread, it raises the timer resolution on Windows while sleeping
+			if (deadline - now > spinMargin)
+			{
+				Clock::duration asked = deadline - now - spinMargin;
+				sf::sleep(sf::microseconds(std::chrono::duration_cast<std::chrono::microseconds>(asked).count()));
+				Clock::duration overslept = Clock::now() - now - asked;
+				//grow at once to the oversleep seen, shrink slowly when the timer turns out better
+				spinMargin = std::clamp<Clock::duration>(std::max(overslept + overslept / 4, spinMargin - spinMargin / 64),
+					MIN_SPIN, MAX_SPIN);
+			}
+			while (Clock::now() < deadline)
+				std::this_thread::yield();
+		}
+	}
+
+	Clock::time_point now = Clock::now();
+	if (!unlimited && now - deadline > std::chrono::microseconds(500))
+		late++;
+	frameMs[frames++ % HISTORY] = std::chrono::duration<float, std::milli>(now - last).count();
+	last = now;
+}
+
+FramePacer::Stats FramePacer::stats() const
+{
+	Stats result;
+	size_t count = std::min(frames, HISTORY);
+	if (count == 0)
+		return result;
+
+	float periodMs = std::chrono::duration<float, std::milli>(period).count();
+	double sum = 0.0, squares = 0.0;
+	for (size_t i = 0; i < count; i++)
+	{
+		sum += frameMs[i];
+		squares += double(frameMs[i]) * frameMs[i];
+		result.worstMs = std::max(result.worstMs, std::abs(frameMs[i] - periodMs));
+	}
+	result.meanMs = float(sum / count);
+	result.jitterMs = float(std::sqrt(std::max(0.0, squares / count - double(result.meanMs) * result.meanMs)));
+	result.late = late;
+	return result;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+//Holds a loop to a fixed frame rate.
+//wait() sleeps through most of the time left in the frame and spins the rest, so the frame ends
+//on the steady clock's deadline instead of whenever the OS scheduler wakes the thread. The spin
+//margin follows the oversleep actually measured, so on a host with a fine timer it stays small.
+//Deadlines advance by exactly one period, an early or late frame doesn't move the ones after it;
+//only a loop more than a frame behind drops the debt and restarts from now.
+class FramePacer
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	//host frame times over the last HISTORY frames
+	struct Stats
+	{
+		float meanMs = 0.0f;
+		//standard deviation of the frame time
+		float jitterMs = 0.0f;
+		//largest distance of a frame time from the period
+		float worstMs = 0.0f;
+		//frames that ended more than half a millisecond past their deadline, since the last reset
+		uint64_t late = 0;
+	};
+
+	static constexpr size_t HISTORY = 128;
+
+private:
+	Clock::duration period;
+	Clock::time_point deadline;
+	Clock::time_point last;
+	Clock::duration spinMargin = std::chrono::milliseconds(2);
+	bool unlimited = false;
+
+	std::array<float, HISTORY> frameMs{};
+	size_t frames = 0;
+	uint64_t late = 0;
+
+public:
+	FramePacer(double rate);
+
+	//blocks until the current frame's deadline, returns at once when unlimited
+	void wait();
+	//starts timing from now, after a pause or anything else that stopped the loop
+	void reset();
+	//uncapped: wait() only records frame times
+	void setUnlimited(bool enabled);
+	bool isUnlimited() const { return unlimited; }
+
+	Stats stats() const;
+};
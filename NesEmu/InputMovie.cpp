@@ -0,0 +1,133 @@
+#include "InputMovie.h"
+#include "Bus.h"
+#include "Common.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+	const char MAGIC[4] = { 'N', 'E', 'S', 'M' };
+	constexpr uint8_t VERSION = 1;
+	constexpr size_t HEADER_SIZE = 20;
+
+	void putLE(uint8_t* out, uint64_t value, int bytes)
+	{
+		for (int i = 0; i < bytes; i++)
+			out[i] = uint8_t(value >> (8 * i));
+	}
+
+	uint64_t getLE(const uint8_t* in, int bytes)
+	{
+		uint64_t value = 0;
+		for (int i = 0; i < bytes; i++)
+			value |= uint64_t(in[i]) << (8 * i);
+		return value;
+	}
+}
+
+uint64_t InputMovie::hashRom(const Bus& bus)
+{
+	auto prg = bus.getCartridge()->getPRG();
+	return fnv1a(prg->data(), prg->size());
+}
+
+void InputMovie::record(Bus& bus, uint8_t ports)
+{
+	this->ports = ports == 1 ? 1 : 2;
+	romHash = hashRom(bus);
+	inputs.clear();
+	position = 0;
+	bus.powerOn();
+	m_mode = Mode::Recording;
+}
+
+bool InputMovie::play(Bus& bus)
+{
+	if (inputs.empty())
+		return false;
+	if (romHash != hashRom(bus))
+	{
+		std::cerr << "Movie was recorded on a different rom" << std::endl;
+		return false;
+	}
+
+	position = 0;
+	bus.controller[0] = 0;
+	bus.controller[1] = 0;
+	bus.powerOn();
+	m_mode = Mode::Playing;
+	return true;
+}
+
+void InputMovie::stop()
+{
+	m_mode = Mode::Idle;
+}
+
+bool InputMovie::frame(Bus& bus)
+{
+	if (m_mode == Mode::Recording)
+	{
+		inputs.insert(inputs.end(), bus.controller, bus.controller + ports);
+		position++;
+		return true;
+	}
+
+	if (m_mode != Mode::Playing)
+		return false;
+	if (position >= frameCount())
+	{
+		m_mode = Mode::Idle;
+		return false;
+	}
+
+	const uint8_t* pads = &inputs[position * ports];
+	bus.controller[0] = pads[0];
+	bus.controller[1] = ports == 2 ? pads[1] : 0;
+	position++;
+	return true;
+}
+
+bool InputMovie::save(const std::string& path) const
+{
+	uint8_t header[HEADER_SIZE] = {};
+	std::copy(MAGIC, MAGIC + 4, header);
+	header[4] = VERSION;
+	header[5] = ports;
+	putLE(header + 8, romHash, 8);
+	putLE(header + 16, frameCount(), 4);
+
+	std::ofstream file(path, std::ios::binary);
+	file.write((const char*)header, HEADER_SIZE);
+	file.write((const char*)inputs.data(), frameCount() * ports);
+	return file.good();
+}
+
+bool InputMovie::load(const std::string& path)
+{
+	std::ifstream file(path, std::ios::binary);
+	uint8_t header[HEADER_SIZE];
+	if (!file.read((char*)header, HEADER_SIZE) || !std::equal(MAGIC, MAGIC + 4, (const char*)header) ||
+		header[4] != VERSION || (header[5] != 1 && header[5] != 2))
+	{
+		std::cerr << "Not a movie file: " << path << std::endl;
+		return false;
+	}
+
+	uint8_t moviePorts = header[5];
+	std::vector<uint8_t> movieInputs(getLE(header + 16, 4) * moviePorts);
+	if (!file.read((char*)movieInputs.data(), movieInputs.size()))
+	{
+		std::cerr << "Movie file is truncated: " << path << std::endl;
+		return false;
+	}
+
+	m_mode = Mode::Idle;
+	ports = moviePorts;
+	romHash = getLE(header + 8, 8);
+	inputs = std::move(movieInputs);
+	position = 0;
+	return true;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cinttypes>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class Bus;
+
+//Pad input recorded one byte per controller per frame. Both recording and playback start from
+//Bus::powerOn, so the same movie on the same rom always replays the same run, whatever the
+//machine ran before.
+//File layout, little endian:
+//	header: "NESM", uint8 version, uint8 ports (1 or 2), uint16 reserved, uint64 prg rom hash, uint32 frames
+//	frames: ports bytes per frame, each a Bus::controller byte
+//frame() has to be called before every emulated frame, steps and clocks in between aren't recorded.
+class InputMovie
+{
+public:
+	enum class Mode
+	{
+		Idle,
+		Recording,
+		Playing
+	};
+
+private:
+	Mode m_mode = Mode::Idle;
+	uint8_t ports = 2;
+	uint64_t romHash = 0;
+	std::vector<uint8_t> inputs;
+	size_t position = 0;
+
+	static uint64_t hashRom(const Bus& bus);
+
+public:
+	//powers the machine on and starts an empty movie
+	void record(Bus& bus, uint8_t ports = 2);
+	//powers the machine on and plays from the first frame, false for an empty movie or one made on another rom
+	bool play(Bus& bus);
+	void stop();
+
+	//recording: appends the pads. playing: sets the pads, returns false and stops once the movie is over
+	bool frame(Bus& bus);
+
+	bool save(const std::string& path) const;
+	bool load(const std::string& path);
+
+	Mode mode() const { return m_mode; }
+	size_t frameCount() const { return inputs.size() / ports; }
+	size_t framePosition() const { return position; }
+};
@@ -0,0 +1,661 @@
+#include "LockstepCpu.h"
+#include "Cartridge.h"
+
+#include <cstring>
+#include <iterator>
+#include <string_view>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace
+{
+	enum : uint8_t
+	{
+		C = 1,
+		Z = 2,
+		I = 4,
+		D = 8,
+		B = 16,
+		U = 32,
+		V = 64,
+		N = 128,
+	};
+
+	constexpr size_t RAM_ROWS = 2048;
+	constexpr size_t PRG_RAM_ROWS = 8192;
+
+	uint8_t setZN(uint8_t status, uint8_t value)
+	{
+		return (status & ~(Z | N)) | (value == 0 ? Z : 0) | (value & N);
+	}
+}
+
+//the cpu's own table with its member pointers turned into Op by mnemonic, so the two can't drift apart
+template <size_t LANES>
+const std::array<typename LockstepCpu<LANES>::Instruction, 256> LockstepCpu<LANES>::instructions = []
+{
+	//in Op order, "???" and anything else unknown is XXX
+	constexpr std::string_view names[] =
+	{
+		"ADC", "AND", "ASL", "BCC", "BCS", "BEQ", "BIT", "BMI", "BNE", "BPL", "BRK", "BVC", "BVS", "CLC", "CLD", "CLI", "CLV", "CMP", "CPX",
+		"CPY", "DEC", "DEX", "DEY", "EOR", "INC", "INX", "INY", "JMP", "JSR", "LDA", "LDX", "LDY", "LSR", "NOP", "ORA", "PHA", "PHP", "PLA",
+		"PLP", "ROL", "ROR", "RTI", "RTS", "SBC", "SEC", "SED", "SEI", "STA", "STX", "STY", "TAX", "TAY", "TSX", "TXA", "TXS", "TYA"
+	};
+	static_assert(std::size(names) == size_t(Op::XXX), "one mnemonic per Op");
+
+	std::array<Instruction, 256> table{};
+	for (int i = 0; i < 256; i++)
+	{
+		uint8_t opcode = uint8_t(i);
+		Op op = Op::XXX;
+		for (size_t n = 0; n < std::size(names); n++)
+		{
+			if (names[n] == nes6502::opcodeName(opcode))
+				op = Op(n);
+		}
+		table[i] = { op, nes6502::addressMode(opcode), nes6502::baseCycles(opcode) };
+	}
+	return table;
+}();
+
+template <size_t LANES>
+LockstepCpu<LANES>::LockstepCpu(const Cartridge& cartridge)
+	: memory(new uint8_t[(RAM_ROWS + PRG_RAM_ROWS) * LANES]()), prg(cartridge.getPRG())
+{
+	prgMask = prg->size() > 0x4000 ? 0x7FFF : 0x3FFF;
+	reset();
+}
+
+template <size_t LANES>
+void LockstepCpu<LANES>::reset()
+{
+	std::memset(memory.get(), 0, (RAM_ROWS + PRG_RAM_ROWS) * LANES);
+	uint16_t vector = (*prg)[0xFFFC & prgMask] | ((*prg)[0xFFFD & prgMask] << 8);
+	for (size_t l = 0; l < LANES; l++)
+	{
+		pc[l] = vector;
+		a[l] = 0;
+		x[l] = 0;
+		y[l] = 0;
+		sp[l] = 0xFD;
+		status[l] = U;
+		cycles[l] = 0;
+	}
+	steps = 0;
+	passes = 0;
+}
+
+template <size_t LANES>
+uint8_t* LockstepCpu<LANES>::row(uint16_t address)
+{
+	if (address <= 0x1FFF)
+		return memory.get() + (address & 0x07FF) * LANES;
+	if (address >= 0x6000 && address <= 0x7FFF)
+		return memory.get() + (RAM_ROWS + (address & 0x1FFF)) * LANES;
+	return nullptr;
+}
+
+template <size_t LANES>
+uint8_t LockstepCpu<LANES>::readLane(size_t lane, uint16_t address)
+{
+	if (uint8_t* r = row(address))
+		return r[lane];
+	if (address >= 0x8000)
+		return (*prg)[address & prgMask];
+	return 0;
+}
+
+template <size_t LANES>
+void LockstepCpu<LANES>::writeLane(size_t lane, uint16_t address, uint8_t data)
+{
+	if (uint8_t* r = row(address))
+		r[lane] = data;
+}
+
+template <size_t LANES>
+uint8_t LockstepCpu<LANES>::peek(size_t lane, uint16_t address)
+{
+	return readLane(lane, address);
+}
+
+template <size_t LANES>
+void LockstepCpu<LANES>::poke(size_t lane, uint16_t address, uint8_t data)
+{
+	writeLane(lane, address, data);
+}
+
+template <size_t LANES>
+void LockstepCpu<LANES>::push(size_t lane, uint8_t data)
+{
+	memory[(0x0100 + sp[lane]) * LANES + lane] = data;
+	sp[lane]--;
+}
+
+template <size_t LANES>
+uint8_t LockstepCpu<LANES>::pull(size_t lane)
+{
+	sp[lane]++;
+	return memory[(0x0100 + sp[lane]) * LANES + lane];
+}
+
+template <size_t LANES>
+template <typename F>
+void LockstepCpu<LANES>::each(F&& body)
+{
+	for (size_t l = 0; l < LANES; l++)
+	{
+		if (active[l])
+			body(l);
+	}
+}
+
+template <size_t LANES>
+void LockstepCpu<LANES>::selectLanes(const uint8_t* pending, uint16_t leadPc)
+{
+#if defined(__AVX2__)
+	if constexpr (LANES == 16)
+	{
+		__m256i same = _mm256_cmpeq_epi16(_mm256_load_si256((const __m256i*)pc), _mm256_set1_epi16((short)leadPc));
+		__m128i packed = _mm_packs_epi16(_mm256_castsi256_si128(same), _mm256_extracti128_si256(same, 1));
+		_mm_store_si128((__m128i*)active, _mm_and_si128(packed, _mm_load_si128((const __m128i*)pending)));
+		return;
+	}
+#endif
+	for (size_t l = 0; l < LANES; l++)
+		active[l] = pc[l] == leadPc ? pending[l] : 0;
+}
+
+template <size_t LANES>
+void LockstepCpu<LANES>::addressing(Mode mode, uint8_t lo, uint8_t hi)
+{
+	uint16_t operand = lo | (hi << 8);
+	uint16_t length = 1;
+	uniformAddr = false;
+
+	switch (mode)
+	{
+	case Mode::IMP:
+	case Mode::ACC:
+		break;
+	case Mode::IMM:
+	case Mode::REL:
+		length = 2;
+		break;
+	case Mode::ZP0:
+		length = 2;
+		uniformAddr = true;
+		addr[lead] = lo;
+		break;
+	case Mode::ZPX:
+		length = 2;
+		for (size_t l = 0; l < LANES; l++)
+			addr[l] = (lo + x[l]) & 0xFF;
+		break;
+	case Mode::ZPY:
+		length = 2;
+		for (size_t l = 0; l < LANES; l++)
+			addr[l] = (lo + y[l]) & 0xFF;
+		break;
+	case Mode::ABS:
+		length = 3;
+		uniformAddr = true;
+		addr[lead] = operand;
+		break;
+	case Mode::ABX:
+		length = 3;
+		for (size_t l = 0; l < LANES; l++)
+		{
+			addr[l] = operand + x[l];
+			crossed[l] = (addr[l] & 0xFF00) != (operand & 0xFF00);
+		}
+		break;
+	case Mode::ABY:
+		length = 3;
+		for (size_t l = 0; l < LANES; l++)
+		{
+			addr[l] = operand + y[l];
+			crossed[l] = (addr[l] & 0xFF00) != (operand & 0xFF00);
+		}
+		break;
+	case Mode::IND:
+		//the pointer high byte doesn't carry out of the page, like the real cpu
+		length = 3;
+		each([&](size_t l)
+		{
+			addr[l] = readLane(l, operand) | (readLane(l, lo == 0xFF ? operand & 0xFF00 : operand + 1) << 8);
+		});
+		break;
+	case Mode::IZX:
+		length = 2;
+		each([&](size_t l)
+		{
+			uint8_t ptr = (lo + x[l]) & 0xFF;
+			addr[l] = readLane(l, ptr) | (readLane(l, (ptr + 1) & 0xFF) << 8);
+		});
+		break;
+	case Mode::IZY:
+		length = 2;
+		each([&](size_t l)
+		{
+			uint16_t base = readLane(l, lo) | (readLane(l, (lo + 1) & 0xFF) << 8);
+			addr[l] = base + y[l];
+			crossed[l] = (addr[l] & 0xFF00) != (base & 0xFF00);
+		});
+		break;
+	}
+
+	if (!uniformAddr && mode != Mode::IMP && mode != Mode::ACC && mode != Mode::IMM && mode != Mode::REL)
+	{
+		bool same = true;
+		for (size_t l = 0; l < LANES; l++)
+			same &= !active[l] || addr[l] == addr[lead];
+		uniformAddr = same;
+	}
+
+	for (size_t l = 0; l < LANES; l++)
+		pc[l] += active[l] ? length : 0;
+}
+
+template <size_t LANES>
+void LockstepCpu<LANES>::load(Mode mode, uint8_t lo)
+{
+	if (mode == Mode::IMM)
+	{
+		std::memset(value, lo, LANES);
+		return;
+	}
+	if (mode == Mode::ACC)
+	{
+		std::memcpy(value, a, LANES);
+		return;
+	}
+
+	if (uniformAddr)
+	{
+		//one row holds the byte of every lane, a single vector load
+		if (const uint8_t* r = row(addr[lead]))
+			std::memcpy(value, r, LANES);
+		else
+			std::memset(value, readLane(lead, addr[lead]), LANES);
+		return;
+	}
+
+	each([&](size_t l) { value[l] = readLane(l, addr[l]); });
+}
+
+template <size_t LANES>
+void LockstepCpu<LANES>::store(Mode mode, const uint8_t* data)
+{
+	if (mode == Mode::ACC)
+	{
+		for (size_t l = 0; l < LANES; l++)
+			a[l] = active[l] ? data[l] : a[l];
+		return;
+	}
+
+	if (!uniformAddr)
+	{
+		each([&](size_t l) { writeLane(l, addr[l], data[l]); });
+		return;
+	}
+
+	uint8_t* r = row(addr[lead]);
+	if (r == nullptr)
+		return;
+
+#if defined(__AVX2__)
+	if constexpr (LANES == 16)
+	{
+		__m128i old = _mm_loadu_si128((const __m128i*)r);
+		__m128i mask = _mm_load_si128((const __m128i*)active);
+		_mm_storeu_si128((__m128i*)r, _mm_blendv_epi8(old, _mm_loadu_si128((const __m128i*)data), mask));
+		return;
+	}
+#endif
+	for (size_t l = 0; l < LANES; l++)
+		r[l] = active[l] ? data[l] : r[l];
+}
+
+template <size_t LANES>
+void LockstepCpu<LANES>::branch(uint8_t flag, bool condition, uint8_t offset)
+{
+	each([&](size_t l)
+	{
+		if (((status[l] & flag) != 0) != condition)
+			return;
+		uint16_t target = pc[l] + (int8_t)offset;
+		cycles[l] += 1 + ((target & 0xFF00) != (pc[l] & 0xFF00));
+		pc[l] = target;
+	});
+}
+
+template <size_t LANES>
+void LockstepCpu<LANES>::step()
+{
+	alignas(64) uint8_t pending[LANES];
+	std::memset(pending, 0xFF, LANES);
+	steps++;
+
+	for (lead = 0; lead < LANES; lead++)
+	{
+		if (!pending[lead])
+			continue;
+
+		uint16_t leadPc = pc[lead];
+		selectLanes(pending, leadPc);
+
+		uint8_t opcode = readLane(lead, leadPc);
+		uint8_t lo = readLane(lead, leadPc + 1);
+		uint8_t hi = readLane(lead, leadPc + 2);
+
+		//code running from ram can differ between lanes at the same pc, those wait for their own pass
+		if (leadPc < 0x8000)
+		{
+			each([&](size_t l)
+			{
+				if (readLane(l, leadPc) != opcode || readLane(l, leadPc + 1) != lo || readLane(l, leadPc + 2) != hi)
+					active[l] = 0;
+			});
+		}
+
+		execute(opcode, lo, hi);
+		passes++;
+
+		for (size_t l = 0; l < LANES; l++)
+			pending[l] &= ~active[l];
+	}
+}
+
+template <size_t LANES>
+void LockstepCpu<LANES>::execute(uint8_t opcode, uint8_t lo, uint8_t hi)
+{
+	const Instruction& inst = instructions[opcode];
+	addressing(inst.mode, lo, hi);
+
+	for (size_t l = 0; l < LANES; l++)
+		cycles[l] += active[l] ? inst.cycle : 0;
+
+	alignas(64) uint8_t result[LANES];
+	bool pageCrossCosts = false;
+
+	switch (inst.op)
+	{
+	case Op::ADC:
+		load(inst.mode, lo);
+		each([&](size_t l)
+		{
+			uint16_t sum = a[l] + value[l] + (status[l] & C);
+			uint8_t r = (uint8_t)sum;
+			bool overflow = ~(a[l] ^ value[l]) & (a[l] ^ r) & 0x80;
+			status[l] = (setZN(status[l], r) & ~(C | V)) | (sum > 0xFF ? C : 0) | (overflow ? V : 0);
+			a[l] = r;
+		});
+		pageCrossCosts = true;
+		break;
+	case Op::SBC:
+		load(inst.mode, lo);
+		each([&](size_t l)
+		{
+			uint16_t sum = a[l] + (value[l] ^ 0xFF) + (status[l] & C);
+			uint8_t r = (uint8_t)sum;
+			bool overflow = (a[l] ^ r) & (~value[l] ^ r) & 0x80;
+			status[l] = (setZN(status[l], r) & ~(C | V)) | (sum > 0xFF ? C : 0) | (overflow ? V : 0);
+			a[l] = r;
+		});
+		pageCrossCosts = true;
+		break;
+	case Op::AND:
+		load(inst.mode, lo);
+		each([&](size_t l) { a[l] &= value[l]; status[l] = setZN(status[l], a[l]); });
+		pageCrossCosts = true;
+		break;
+	case Op::ORA:
+		load(inst.mode, lo);
+		each([&](size_t l) { a[l] |= value[l]; status[l] = setZN(status[l], a[l]); });
+		pageCrossCosts = true;
+		break;
+	case Op::EOR:
+		load(inst.mode, lo);
+		each([&](size_t l) { a[l] ^= value[l]; status[l] = setZN(status[l], a[l]); });
+		pageCrossCosts = true;
+		break;
+	case Op::CMP:
+	case Op::CPX:
+	case Op::CPY:
+	{
+		load(inst.mode, lo);
+		const uint8_t* reg = inst.op == Op::CMP ? a : inst.op == Op::CPX ? x : y;
+		each([&](size_t l)
+		{
+			status[l] = (setZN(status[l], reg[l] - value[l]) & ~C) | (reg[l] >= value[l] ? C : 0);
+		});
+		pageCrossCosts = inst.op == Op::CMP;
+		break;
+	}
+	case Op::BIT:
+		load(inst.mode, lo);
+		each([&](size_t l)
+		{
+			status[l] = (status[l] & ~(Z | N | V)) | ((a[l] & value[l]) == 0 ? Z : 0) | (value[l] & (N | V));
+		});
+		break;
+	case Op::LDA:
+	case Op::LDX:
+	case Op::LDY:
+	{
+		load(inst.mode, lo);
+		uint8_t* reg = inst.op == Op::LDA ? a : inst.op == Op::LDX ? x : y;
+		each([&](size_t l) { reg[l] = value[l]; status[l] = setZN(status[l], value[l]); });
+		pageCrossCosts = true;
+		break;
+	}
+	case Op::STA:
+		store(inst.mode, a);
+		break;
+	case Op::STX:
+		store(inst.mode, x);
+		break;
+	case Op::STY:
+		store(inst.mode, y);
+		break;
+	case Op::ASL:
+		load(inst.mode, lo);
+		each([&](size_t l)
+		{
+			result[l] = value[l] << 1;
+			status[l] = (setZN(status[l], result[l]) & ~C) | (value[l] >> 7);
+		});
+		store(inst.mode, result);
+		break;
+	case Op::LSR:
+		load(inst.mode, lo);
+		each([&](size_t l)
+		{
+			result[l] = value[l] >> 1;
+			status[l] = (setZN(status[l], result[l]) & ~C) | (value[l] & C);
+		});
+		store(inst.mode, result);
+		break;
+	case Op::ROL:
+		load(inst.mode, lo);
+		each([&](size_t l)
+		{
+			result[l] = (value[l] << 1) | (status[l] & C);
+			status[l] = (setZN(status[l], result[l]) & ~C) | (value[l] >> 7);
+		});
+		store(inst.mode, result);
+		break;
+	case Op::ROR:
+		load(inst.mode, lo);
+		each([&](size_t l)
+		{
+			result[l] = ((status[l] & C) << 7) | (value[l] >> 1);
+			status[l] = (setZN(status[l], result[l]) & ~C) | (value[l] & C);
+		});
+		store(inst.mode, result);
+		break;
+	case Op::INC:
+	case Op::DEC:
+	{
+		load(inst.mode, lo);
+		uint8_t delta = inst.op == Op::INC ? 1 : 0xFF;
+		each([&](size_t l)
+		{
+			result[l] = value[l] + delta;
+			status[l] = setZN(status[l], result[l]);
+		});
+		store(inst.mode, result);
+		break;
+	}
+	case Op::INX:
+		each([&](size_t l) { x[l]++; status[l] = setZN(status[l], x[l]); });
+		break;
+	case Op::INY:
+		each([&](size_t l) { y[l]++; status[l] = setZN(status[l], y[l]); });
+		break;
+	case Op::DEX:
+		each([&](size_t l) { x[l]--; status[l] = setZN(status[l], x[l]); });
+		break;
+	case Op::DEY:
+		each([&](size_t l) { y[l]--; status[l] = setZN(status[l], y[l]); });
+		break;
+	case Op::TAX:
+		each([&](size_t l) { x[l] = a[l]; status[l] = setZN(status[l], x[l]); });
+		break;
+	case Op::TAY:
+		each([&](size_t l) { y[l] = a[l]; status[l] = setZN(status[l], y[l]); });
+		break;
+	case Op::TSX:
+		each([&](size_t l) { x[l] = sp[l]; status[l] = setZN(status[l], x[l]); });
+		break;
+	case Op::TXA:
+		each([&](size_t l) { a[l] = x[l]; status[l] = setZN(status[l], a[l]); });
+		break;
+	case Op::TYA:
+		each([&](size_t l) { a[l] = y[l]; status[l] = setZN(status[l], a[l]); });
+		break;
+	case Op::TXS:
+		each([&](size_t l) { sp[l] = x[l]; });
+		break;
+	case Op::CLC:
+		each([&](size_t l) { status[l] &= ~C; });
+		break;
+	case Op::CLD:
+		each([&](size_t l) { status[l] &= ~D; });
+		break;
+	case Op::CLI:
+		each([&](size_t l) { status[l] &= ~I; });
+		break;
+	case Op::CLV:
+		each([&](size_t l) { status[l] &= ~V; });
+		break;
+	case Op::SEC:
+		each([&](size_t l) { status[l] |= C; });
+		break;
+	case Op::SED:
+		each([&](size_t l) { status[l] |= D; });
+		break;
+	case Op::SEI:
+		each([&](size_t l) { status[l] |= I; });
+		break;
+	case Op::BCC:
+		branch(C, false, lo);
+		break;
+	case Op::BCS:
+		branch(C, true, lo);
+		break;
+	case Op::BNE:
+		branch(Z, false, lo);
+		break;
+	case Op::BEQ:
+		branch(Z, true, lo);
+		break;
+	case Op::BPL:
+		branch(N, false, lo);
+		break;
+	case Op::BMI:
+		branch(N, true, lo);
+		break;
+	case Op::BVC:
+		branch(V, false, lo);
+		break;
+	case Op::BVS:
+		branch(V, true, lo);
+		break;
+	case Op::JMP:
+		each([&](size_t l) { pc[l] = addr[uniformAddr ? lead : l]; });
+		break;
+	case Op::JSR:
+		each([&](size_t l)
+		{
+			uint16_t pushed = pc[l] - 1;
+			push(l, pushed >> 8);
+			push(l, pushed & 0xFF);
+			pc[l] = addr[lead];
+		});
+		break;
+	case Op::RTS:
+		each([&](size_t l)
+		{
+			uint16_t target = pull(l);
+			target |= pull(l) << 8;
+			pc[l] = target + 1;
+		});
+		break;
+	case Op::RTI:
+		each([&](size_t l)
+		{
+			status[l] = pull(l) & ~(B | U);
+			uint16_t target = pull(l);
+			pc[l] = target | (pull(l) << 8);
+		});
+		break;
+	case Op::BRK:
+	{
+		uint16_t vector = (*prg)[0xFFFE & prgMask] | ((*prg)[0xFFFF & prgMask] << 8);
+		each([&](size_t l)
+		{
+			pc[l]++;
+			status[l] |= I;
+			push(l, pc[l] >> 8);
+			push(l, pc[l] & 0xFF);
+			push(l, status[l] | B);
+			pc[l] = vector;
+		});
+		break;
+	}
+	case Op::PHA:
+		each([&](size_t l) { push(l, a[l]); });
+		break;
+	case Op::PHP:
+		each([&](size_t l)
+		{
+			push(l, status[l] | B | U);
+			status[l] &= ~(B | U);
+		});
+		break;
+	case Op::PLA:
+		each([&](size_t l) { a[l] = pull(l); status[l] = setZN(status[l], a[l]); });
+		break;
+	case Op::PLP:
+		each([&](size_t l) { status[l] = pull(l) | U; });
+		break;
+	case Op::NOP:
+		//the unofficial absolute,x nops take the page cross cycle too
+		pageCrossCosts = opcode == 0x1C || opcode == 0x3C || opcode == 0x5C || opcode == 0x7C || opcode == 0xDC || opcode == 0xFC;
+		break;
+	case Op::XXX:
+		break;
+	}
+
+	if (pageCrossCosts && (inst.mode == Mode::ABX || inst.mode == Mode::ABY || inst.mode == Mode::IZY))
+	{
+		for (size_t l = 0; l < LANES; l++)
+			cycles[l] += active[l] ? crossed[l] : 0;
+	}
+}
+
+template class LockstepCpu<8>;
+template class LockstepCpu<16>;
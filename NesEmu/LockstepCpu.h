@@ -0,0 +1,103 @@
+#pragma once
+
+#include "nes6502.h"
+
+#include <array>
+#include <cinttypes>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+class Cartridge;
+
+//Experimental: LANES copies of the cpu side of a machine (cpu, 2 KB ram, 8 KB prg ram, prg rom)
+//stepped in lockstep, one instruction per lane per step().
+//Registers are arrays over lanes and memory is stored lane-interleaved (mem[address][lane]), so an
+//access to the same address in every lane is one vector load or store. Lanes whose pc agrees share
+//the opcode fetch and decode and run the instruction as one masked loop over the lanes; lanes on
+//other pcs are picked up by further passes of the same step, each with its own decode.
+//The per-lane loops are written to auto-vectorize, building with AVX2 (/arch:AVX2, -mavx2) also
+//turns on hand-written paths for the pc agreement and whole-row memory accesses.
+//Not a full machine: ppu and apu registers read 0 and ignore writes, there are no interrupts,
+//and only mapper 000 prg layouts are supported. Instruction semantics and cycle counts follow
+//the fast nes6502 tier exactly so lanes can be checked against scalar cpus.
+template <size_t LANES>
+class LockstepCpu
+{
+	static_assert(LANES == 8 || LANES == 16, "8 or 16 lanes, one vector register of 8 or 16-bit values");
+
+public:
+	static constexpr size_t lanes = LANES;
+
+	alignas(64) uint16_t pc[LANES];
+	alignas(64) uint8_t a[LANES];
+	alignas(64) uint8_t x[LANES];
+	alignas(64) uint8_t y[LANES];
+	alignas(64) uint8_t sp[LANES];
+	alignas(64) uint8_t status[LANES];
+	alignas(64) uint64_t cycles[LANES];
+
+	//steps run, and decode passes they needed, passes == steps means the lanes never diverged
+	uint64_t steps = 0;
+	uint64_t passes = 0;
+
+private:
+	enum class Op : uint8_t
+	{
+		ADC, AND, ASL, BCC, BCS, BEQ, BIT, BMI, BNE, BPL, BRK, BVC, BVS, CLC, CLD, CLI, CLV, CMP, CPX,
+		CPY, DEC, DEX, DEY, EOR, INC, INX, INY, JMP, JSR, LDA, LDX, LDY, LSR, NOP, ORA, PHA, PHP, PLA,
+		PLP, ROL, ROR, RTI, RTS, SBC, SEC, SED, SEI, STA, STX, STY, TAX, TAY, TSX, TXA, TXS, TYA, XXX
+	};
+
+	using Mode = AddressMode;
+
+	struct Instruction
+	{
+		Op op;
+		Mode mode;
+		uint8_t cycle;
+	};
+
+	//decoded from nes6502's table, see LockstepCpu.cpp
+	static const std::array<Instruction, 256> instructions;
+
+	//ram rows 0-2047 then prg ram rows 0-8191, LANES bytes each
+	std::unique_ptr<uint8_t[]> memory;
+	std::shared_ptr<const std::vector<uint8_t>> prg;
+	uint16_t prgMask = 0;
+
+	//state of the pass being executed
+	alignas(64) uint8_t active[LANES];
+	alignas(64) uint16_t addr[LANES];
+	alignas(64) uint8_t value[LANES];
+	alignas(64) uint8_t crossed[LANES];
+	bool uniformAddr = false;
+	size_t lead = 0;
+
+	uint8_t* row(uint16_t address);
+	uint8_t readLane(size_t lane, uint16_t address);
+	void writeLane(size_t lane, uint16_t address, uint8_t data);
+	void push(size_t lane, uint8_t data);
+	//runs body for every lane of the current pass
+	template <typename F>
+	void each(F&& body);
+	uint8_t pull(size_t lane);
+
+	void selectLanes(const uint8_t* pending, uint16_t leadPc);
+	void addressing(Mode mode, uint8_t lo, uint8_t hi);
+	void load(Mode mode, uint8_t lo);
+	void store(Mode mode, const uint8_t* data);
+	void branch(uint8_t flag, bool condition, uint8_t offset);
+	void execute(uint8_t opcode, uint8_t lo, uint8_t hi);
+
+public:
+	//mapper 000 only, the prg rom is shared with the cartridge
+	LockstepCpu(const Cartridge& cartridge);
+
+	//power on every lane: ram cleared, registers as nes6502::reset, pc from the reset vector
+	void reset();
+	void step();
+
+	uint8_t peek(size_t lane, uint16_t address);
+	void poke(size_t lane, uint16_t address, uint8_t data);
+};
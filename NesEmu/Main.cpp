@@ -3,23 +3,431 @@
 #include <iomanip>
 #include <cstdlib>
 #include <fstream>
+#include <vector>
+#include <chrono>
+#include <algorithm>
 
 #include <SFML/Graphics.hpp>
 
 #include "Common.h"
 #include "Cartridge.h"
 #include "Bus.h"
+#include "BatchRunner.h"
+#include "BranchRunner.h"
+#include "Disassembly.h"
+#include "InputMovie.h"
+#include "LockstepCpu.h"
+#include "ThreadPool.h"
 
 #include "NesScreen.h"
 
 #include <cstdlib>
 
-int main()
+//NesEmu --batch [--frames N] [--threads N] [--report file] rom...
+//runs the roms headless on all cores and writes a JSON report, to stdout without --report
+static int runBatchCommand(int argc, char* argv[])
 {
+	BatchOptions options;
+	size_t threads = 0;
+	std::string reportPath;
+	std::vector<std::string> roms;
+
+	for (int i = 2; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--frames" && i + 1 < argc)
+			options.frameLimit = std::strtoul(argv[++i], nullptr, 10);
+		else if (arg == "--threads" && i + 1 < argc)
+			threads = std::strtoul(argv[++i], nullptr, 10);
+		else if (arg == "--report" && i + 1 < argc)
+			reportPath = argv[++i];
+		else
+			roms.push_back(arg);
+	}
+
+	ThreadPool pool(threads);
+	auto results = runBatch(roms, options, pool);
+
+	if (reportPath.empty())
+		writeReport(std::cout, results);
+	else
+	{
+		std::ofstream report(reportPath);
+		writeReport(report, results);
+	}
+
+	for (const auto& result : results)
+	{
+		if (result.outcome != BatchResult::Outcome::Pass)
+			return 1;
+	}
+	return 0;
+}
+
+//scripted input for --record and the checks: Start for a few frames, then walk right and jump
+static uint8_t scriptedPad(int frame)
+{
+	return frame >= 120 && frame < 130 ? 0x08 : frame > 300 ? ((frame / 40) % 2 ? 0x80 : 0x41) : 0x00;
+}
+
+static uint64_t stateHash(const Bus& nes)
+{
+	return fnv1a(nes.getRam().data(), nes.getRam().size(),
+		fnv1a(nes.ppu.getFrameBuffer(), nes2c02::SCREEN_WIDTH * nes2c02::SCREEN_HEIGHT));
+}
+
+//NesEmu --movie file rom
+//plays a movie headless and prints its run time and a hash of the final ram and frame, the same
+//movie always ends on the same hash so it doubles as a fixed workload for timing the emulator
+static int runMovieCommand(int argc, char* argv[])
+{
+	if (argc < 4)
+	{
+		std::cerr << "usage: NesEmu --movie file rom" << std::endl;
+		return 1;
+	}
+
+	auto cart = std::make_shared<Cartridge>(argv[3]);
+	if (!cart->imageValid())
+		return 1;
+
+	Bus nes;
+	nes.insertCartridge(cart);
+	//nothing reads the samples, a full buffer would be drained on every apu event and skew the timing
+	nes.apu.setOutput(false);
+	InputMovie movie;
+	if (!movie.load(argv[2]) || !movie.play(nes))
+		return 1;
+
+	auto start = std::chrono::steady_clock::now();
+	while (movie.frame(nes))
+		nes.runFrame();
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	std::cout << movie.frameCount() << " frames in " << ms << " ms (" << movie.frameCount() * 1000.0 / ms <<
+		" fps), final state " << std::hex << stateHash(nes) << std::dec << std::endl;
+	return 0;
+}
+
+//NesEmu --record file rom [frames]
+//records the scripted input headless for frames frames, 900 by default, and prints the final hash
+//--movie has to end on for the same rom
+static int runRecordCommand(int argc, char* argv[])
+{
+	if (argc < 4)
+	{
+		std::cerr << "usage: NesEmu --record file rom [frames]" << std::endl;
+		return 1;
+	}
+
+	auto cart = std::make_shared<Cartridge>(argv[3]);
+	if (!cart->imageValid())
+		return 1;
+	int frames = argc > 4 ? std::atoi(argv[4]) : 900;
+
+	Bus nes;
+	nes.insertCartridge(cart);
+	nes.apu.setOutput(false);
+	InputMovie movie;
+	movie.record(nes, 1);
+	for (int frame = 0; frame < frames; frame++)
+	{
+		nes.controller[0] = scriptedPad(frame);
+		movie.frame(nes);
+		nes.runFrame();
+	}
+	movie.stop();
+	if (!movie.save(argv[2]))
+		return 1;
+
+	std::cout << movie.frameCount() << " frames recorded, final state " << std::hex << stateHash(nes) << std::dec << std::endl;
+	return 0;
+}
+
+//a check prints [PASS] or [FAIL] and its numbers on one line and returns whether it passed
+static std::shared_ptr<Cartridge> loadCheckRom(const std::string& path, const char* check)
+{
+	auto cart = std::make_shared<Cartridge>(path);
+	if (cart->imageValid())
+		return cart;
+	std::cout << "[FAIL] " << check << ", cannot load " << path << std::endl;
+	return nullptr;
+}
+
+//save state round trip: save, run, load, run again, frames, ram and the apu must match
+static bool checkSaveState(const std::string& rom)
+{
+	auto cart = loadCheckRom(rom, "save state round trip");
+	if (!cart)
+		return false;
+	Bus nes;
+	nes.insertCartridge(cart);
+	nes.reset();
+	nes.apu.setOutput(false);
+
+	auto runFrames = [&](int count)
+	{
+		std::vector<uint64_t> hashes;
+		for (int i = 0; i < count; i++)
+		{
+			nes.runFrame();
+			//irq before $4015, reading it clears the frame irq
+			uint8_t apu[2] = { uint8_t(nes.apu.irq()), nes.cpuRead(0x4015) };
+			hashes.push_back(fnv1a(apu, sizeof(apu), fnv1a(nes.getRam().data(), nes.getRam().size(),
+				fnv1a(nes.ppu.getFrameBuffer(), nes2c02::SCREEN_WIDTH * nes2c02::SCREEN_HEIGHT))));
+		}
+		return hashes;
+	};
+
+	runFrames(30);
+	//nestest leaves the apu alone: arm the frame irq and load every length counter (254 half frames,
+	//longer than the test), so $4015 has length and irq bits that a lost apu state would clear
+	nes.cpuWrite(0x4017, 0x00);
+	nes.cpuWrite(0x4015, 0x0F);
+	for (uint16_t lengthLoad : { 0x4003, 0x4007, 0x400B, 0x400F })
+		nes.cpuWrite(lengthLoad, 0x08);
+	std::vector<uint8_t> state;
+	nes.saveState(state);
+	auto first = runFrames(60);
+
+	bool loaded = nes.loadState(state);
+	auto second = runFrames(60);
+
+	bool pass = loaded && first == second;
+	std::cout << (pass ? "[PASS]" : "[FAIL]") << " save state round trip, " << state.size() << " bytes" << std::endl;
+	return pass;
+}
+
+//branch search: fork one state into a branch per button, each branch has to end where a machine
+//loaded from a save state of the root ends with the same input, and the root must not move
+static bool checkBranches(const std::string& rom)
+{
+	auto cart = loadCheckRom(rom, "branch search");
+	if (!cart)
+		return false;
+	Bus nes;
+	nes.insertCartridge(cart);
+	nes.reset();
+	nes.apu.setOutput(false);
+	for (int i = 0; i < 30; i++)
+		nes.runFrame();
+
+	std::vector<std::vector<uint8_t>> inputs;
+	for (int button = 0; button < 8; button++)
+		inputs.push_back(std::vector<uint8_t>(60, uint8_t(1 << button)));
+
+	std::vector<uint8_t> rootState, rootAfter;
+	nes.saveState(rootState);
+	ThreadPool pool;
+	auto results = runBranches(nes, inputs, pool);
+	nes.saveState(rootAfter);
+
+	int mismatches = 0;
+	for (size_t i = 0; i < inputs.size(); i++)
+	{
+		//its own cartridge, the root's is shared with the forks
+		Bus copy;
+		copy.insertCartridge(std::make_shared<Cartridge>(rom));
+		copy.loadState(rootState);
+		copy.apu.setOutput(false);
+		for (uint8_t buttons : inputs[i])
+		{
+			copy.controller[0] = buttons;
+			copy.runFrame();
+		}
+		if (results[i].ramHash != fnv1a(copy.getRam().data(), copy.getRam().size()) ||
+			results[i].frameHash != fnv1a(copy.ppu.getFrameBuffer(), nes2c02::SCREEN_WIDTH * nes2c02::SCREEN_HEIGHT))
+			mismatches++;
+	}
+
+	bool pass = mismatches == 0 && rootState == rootAfter;
+	std::cout << (pass ? "[PASS]" : "[FAIL]") << " branch search, " << mismatches << " of " << inputs.size() <<
+		" branches differ, root " << (rootState == rootAfter ? "unchanged" : "changed") << std::endl;
+	return pass;
+}
+
+//run-ahead: a machine that runs ahead and loads back every frame, as NesScreen does, has to stay
+//on the plain machine's ram, apu irq and full state and make the same samples, frame for frame
+static bool checkRunAhead(const std::string& rom)
+{
+	constexpr unsigned RUN_AHEAD = 2;
+	auto cart = loadCheckRom(rom, "run-ahead determinism");
+	if (!cart)
+		return false;
+	Bus plain, ahead;
+	plain.insertCartridge(cart);
+	ahead.insertCartridge(cart);
+	plain.reset();
+	ahead.reset();
+
+	std::vector<uint8_t> saved, plainState, aheadState;
+	std::vector<int16_t> plainSamples(8192), aheadSamples(8192);
+	int mismatches = 0;
+	for (int frame = 0; frame < 900; frame++)
+	{
+		uint8_t pad = scriptedPad(frame);
+		plain.controller[0] = pad;
+		ahead.controller[0] = pad;
+		plain.runFrame();
+
+		ahead.ppu.setRendering(false);
+		ahead.runFrame();
+		ahead.saveState(saved);
+		ahead.apu.setOutput(false);
+		for (unsigned i = 1; i < RUN_AHEAD; i++)
+			ahead.runFrame();
+		ahead.ppu.setRendering(true);
+		ahead.runFrame();
+		ahead.loadState(saved);
+		ahead.apu.setOutput(true);
+
+		plain.saveState(plainState);
+		ahead.saveState(aheadState);
+		size_t plainCount = plain.apu.readSamples(plainSamples.data(), plainSamples.size());
+		size_t aheadCount = ahead.apu.readSamples(aheadSamples.data(), aheadSamples.size());
+		if (plain.getRam() != ahead.getRam() || plain.apu.irq() != ahead.apu.irq() || plainState != aheadState ||
+			plainCount != aheadCount || !std::equal(plainSamples.begin(), plainSamples.begin() + plainCount, aheadSamples.begin()))
+			mismatches++;
+	}
+
+	bool pass = mismatches == 0;
+	std::cout << (pass ? "[PASS]" : "[FAIL]") << " run-ahead determinism, " << mismatches << " of 900 frames differ" << std::endl;
+	return pass;
+}
+
+//lockstep cpu: 16 copies of nestest against 16 scalar cpus, registers must match and the lockstep side should be faster
+static bool checkLockstep(const std::string& rom)
+{
+	constexpr size_t LANES = 16;
+	constexpr int STEPS = 8000;
+	auto cart = loadCheckRom(rom, "lockstep");
+	if (!cart)
+		return false;
+	std::vector<std::unique_ptr<Bus>> machines;
+	for (size_t i = 0; i < LANES; i++)
+	{
+		machines.push_back(std::make_unique<Bus>());
+		machines[i]->insertCartridge(cart);
+		machines[i]->reset();
+		machines[i]->cpu.pc = 0xC000;
+		machines[i]->cpu.cycles = 0;
+	}
+
+	LockstepCpu<LANES> lockstep(*cart);
+	for (size_t i = 0; i < LANES; i++)
+		lockstep.pc[i] = 0xC000;
+
+	auto start = std::chrono::steady_clock::now();
+	for (auto& machine : machines)
+	{
+		for (int i = 0; i < STEPS; i++)
+		{
+			do machine->cpu.clock(); while (machine->cpu.cycles);
+		}
+	}
+	auto middle = std::chrono::steady_clock::now();
+	for (int i = 0; i < STEPS; i++)
+		lockstep.step();
+	auto end = std::chrono::steady_clock::now();
+
+	bool pass = true;
+	for (size_t i = 0; i < LANES; i++)
+	{
+		const auto& cpu = machines[i]->cpu;
+		pass &= cpu.pc == lockstep.pc[i] && cpu.reg_a == lockstep.a[i] && cpu.reg_x == lockstep.x[i] &&
+			cpu.reg_y == lockstep.y[i] && cpu.sp == lockstep.sp[i] && cpu.status_reg == lockstep.status[i];
+	}
+
+	std::cout << (pass ? "[PASS]" : "[FAIL]") << " lockstep, scalar " << std::chrono::duration<double, std::milli>(middle - start).count() <<
+		" ms, lockstep " << std::chrono::duration<double, std::milli>(end - middle).count() << " ms, " <<
+		double(lockstep.passes) / lockstep.steps << " passes per step" << std::endl;
+	return pass;
+}
+
+//headless movie: record scripted input, save and load it, play it back, both runs have to end on the same state
+static bool checkMovie(const std::string& rom)
+{
+	auto cart = loadCheckRom(rom, "movie replay");
+	if (!cart)
+		return false;
+
+	Bus recorder;
+	recorder.insertCartridge(cart);
+	recorder.apu.setOutput(false);
+	InputMovie movie;
+	movie.record(recorder);
+	for (int frame = 0; frame < 900; frame++)
+	{
+		recorder.controller[0] = scriptedPad(frame);
+		movie.frame(recorder);
+		recorder.runFrame();
+	}
+	movie.stop();
+
+	Bus player;
+	player.insertCartridge(cart);
+	player.apu.setOutput(false);
+	InputMovie replay;
+	bool played = movie.save("movie.nesm") && replay.load("movie.nesm") && replay.play(player);
+	while (played && replay.frame(player))
+		player.runFrame();
+
+	bool cold = played && stateHash(recorder) == stateHash(player);
+
+	//a warm machine: scribble over every memory a reset keeps, playing on it has to end where the cold machine did
+	for (uint16_t addr = 0x0000; addr < 0x0800; addr++)
+		recorder.cpuWrite(addr, 0xA5);
+	for (uint16_t addr = 0x6000; addr < 0x8000; addr++)
+		recorder.cpuWrite(addr, 0xA5);
+	for (uint16_t addr = 0x0000; addr < 0x3F20; addr++)
+		recorder.ppu.ppuWrite(addr, uint8_t(addr));
+	recorder.cpuWrite(0x2003, 0x00);
+	for (int i = 0; i < 256; i++)
+		recorder.cpuWrite(0x2004, 0xA5);
+	bool warm = replay.play(recorder);
+	while (warm && replay.frame(recorder))
+		recorder.runFrame();
+	warm = warm && stateHash(recorder) == stateHash(player);
+
+	bool pass = cold && warm;
+	std::cout << (pass ? "[PASS]" : "[FAIL]") << " movie replay, " << replay.frameCount() << " frames, " <<
+		(cold ? "cold" : "cold differs") << ", " << (warm ? "warm" : "warm differs") << std::endl;
+	return pass;
+}
+
+//NesEmu --selftest [nestest [game]]
+//runs every check headless and fails if any of them does, the roms default to the ones in tests.
+//game is played with scripted input, Donkey Kong by default
+static int runSelfTestCommand(int argc, char* argv[])
+{
+	std::string nestest = argc > 2 ? argv[2] : "..\\tests\\nestest.nes";
+	std::string game = argc > 3 ? argv[3] : "..\\tests\\Donkey Kong.nes";
+
+	bool pass = true;
+	pass &= checkSaveState(nestest);
+	pass &= checkBranches(nestest);
+	pass &= checkLockstep(nestest);
+	pass &= checkRunAhead(game);
+	pass &= checkMovie(game);
+	//nestest keeps what it finds in ram, so it is the one that catches a movie starting warm
+	pass &= checkMovie(nestest);
+	return pass ? 0 : 1;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc > 1 && std::string(argv[1]) == "--batch")
+		return runBatchCommand(argc, argv);
+	if (argc > 1 && std::string(argv[1]) == "--movie")
+		return runMovieCommand(argc, argv);
+	if (argc > 1 && std::string(argv[1]) == "--record")
+		return runRecordCommand(argc, argv);
+	if (argc > 1 && std::string(argv[1]) == "--selftest")
+		return runSelfTestCommand(argc, argv);
+
 #if 1
 	NesScreen nes("..\\tests\\nestest.nes");
 	nes.init();
-	nes.printImage("out.txt");
 	bool run = true;
 	while (run)
 	{
@@ -32,7 +440,7 @@ int main()
 	auto cart = std::make_shared<Cartridge>("..\\tests\\nestest.nes");
 	nes.insertCartridge(cart);
 	nes.reset();
-	auto ram = nes.cpu.dissamble(0x0000, 0xFFFF);
+	Disassembly code(nes);
 	while (true)
 	{
 		uint16_t pc_prev = nes.cpu.pc;
@@ -53,15 +461,10 @@ int main()
 		}
 		std::cout << c << "\n\n";
 
-		auto it = ram.find(nes.cpu.pc);
-		for (int i = 0; i < 7 && it != ram.begin(); i++)
-			it--;
-
-		for (int i = 0; i < 16; i++)
-		{
-			std::cout << (it->first == nes.cpu.pc ? "->" : "  ") << it->second << "\n";
-			it++;
-		}
+		Disassembly::Line lines[16];
+		size_t count = code.window(nes.cpu.pc, 7, lines, 16);
+		for (size_t i = 0; i < count; i++)
+			std::cout << (lines[i].address == nes.cpu.pc ? "->" : "  ") << Disassembly::format(lines[i]) << "\n";
 
 		std::cin.get();
 		system("cls");
@@ -1,6 +1,10 @@
 #pragma once
 
 #include <cinttypes>
+#include <memory>
+
+class StateWriter;
+class StateReader;
 
 class Mapper
 {
@@ -18,5 +22,14 @@ public:
 	virtual bool ppuMapRead(uint16_t addr, uint32_t& mapped_addr) = 0;
 	
 	virtual void reset() = 0;
+
+	//independent copy of the bank registers, used when a cartridge is forked
+	virtual std::shared_ptr<Mapper> clone() const = 0;
+	//takes over the bank registers of other, which is the same kind of mapper
+	virtual void copyFrom(const Mapper& other) = 0;
+
+	//mappers with bank registers save them as their own chunk, mapper 000 has none
+	virtual void saveState(StateWriter& /*writer*/) const {}
+	virtual bool loadState(const StateReader& /*reader*/) { return true; }
 };
 
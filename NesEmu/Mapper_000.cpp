@@ -43,3 +43,13 @@ bool Mapper_000::ppuMapRead(uint16_t addr, uint32_t& mapped_addr)
 void Mapper_000::reset()
 {
 }
+
+std::shared_ptr<Mapper> Mapper_000::clone() const
+{
+    return std::make_shared<Mapper_000>(*this);
+}
+
+void Mapper_000::copyFrom(const Mapper& other)
+{
+    *this = static_cast<const Mapper_000&>(other);
+}
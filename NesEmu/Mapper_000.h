@@ -16,5 +16,8 @@ public:
 	bool ppuMapRead(uint16_t addr, uint32_t& mapped_addr) override;
 
 	void reset() override;
+
+	std::shared_ptr<Mapper> clone() const override;
+	void copyFrom(const Mapper& other) override;
 };
 
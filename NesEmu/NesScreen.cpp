@@ -1,11 +1,40 @@
 #include "NesScreen.h"
 #include "Common.h"
 
+#include <cstring>
 #include <fstream>
 
-void NesScreen::renderRegisters()
+float NesScreen::appendText(const std::string& text, float x, float y, sf::Color color)
 {
-	uint8_t flag = bus.cpu.status_reg;
+	//same layout as sf::Text: baseline one character size below the top, no kerning for a monospace font
+	float left = x;
+	float baseline = y + TEXT_SIZE;
+	for (char c : text)
+	{
+		if (c == '\n')
+		{
+			x = left;
+			baseline += font.getLineSpacing(TEXT_SIZE);
+			continue;
+		}
+
+		const sf::Glyph& glyph = font.getGlyph(uint8_t(c), TEXT_SIZE, false);
+		float x0 = x + glyph.bounds.left, y0 = baseline + glyph.bounds.top;
+		float x1 = x0 + glyph.bounds.width, y1 = y0 + glyph.bounds.height;
+		float u0 = float(glyph.textureRect.left), v0 = float(glyph.textureRect.top);
+		float u1 = u0 + glyph.textureRect.width, v1 = v0 + glyph.textureRect.height;
+		panelText.append(sf::Vertex({ x0, y0 }, color, { u0, v0 }));
+		panelText.append(sf::Vertex({ x1, y0 }, color, { u1, v0 }));
+		panelText.append(sf::Vertex({ x1, y1 }, color, { u1, v1 }));
+		panelText.append(sf::Vertex({ x0, y1 }, color, { u0, v1 }));
+		x += glyph.advance;
+	}
+	return baseline - TEXT_SIZE + font.getLineSpacing(TEXT_SIZE);
+}
+
+float NesScreen::renderRegisters()
+{
+	uint8_t flag = shown->status;
 	std::string c = "N V U B D I Z C";
 
 	for (int i = 0; i < 16; i += 2)
@@ -15,153 +44,482 @@ void NesScreen::renderRegisters()
 		flag <<= 1;
 	}
 
-	std::string regInfo = "Status: " + c + "\nA: " + hex(bus.cpu.reg_a) +
-		"\nX: " + hex(bus.cpu.reg_x) +
-		"\nY: " + hex(bus.cpu.reg_y) +
-		"\nSP: " + hex(bus.cpu.sp) +
-		"\nPC: " + hex(bus.cpu.pc);
+	std::string regInfo = "Status: " + c + "\nA: " + hex(shown->a) +
+		"\nX: " + hex(shown->x) +
+		"\nY: " + hex(shown->y) +
+		"\nSP: " + hex(shown->sp) +
+		"\nPC: " + hex(shown->pc) +
+		(shown->movieMode == InputMovie::Mode::Recording ? "\nRecording: frame " + std::to_string(shown->moviePosition) :
+		shown->movieMode == InputMovie::Mode::Playing ? "\nPlaying: frame " + std::to_string(shown->moviePosition) + "/" + std::to_string(shown->movieFrames) : "") +
+		"\n" + stats +
+		"\n" + debugInfo;
 	// + "\nCyc:" + hex(bus.cpu.cycles);
 
-	sf::Text text(regInfo, font, 16);
-	text.setFillColor(sf::Color::White);
-	text.setPosition(650, 0);
-	window.draw(text);
+	return appendText(regInfo, TEXT_X, 0, sf::Color::White);
+}
+
+uint8_t NesScreen::readPad()
+{
+	using Key = sf::Keyboard;
+	const Key::Key buttons[8] = { Key::K, Key::J, Key::RShift, Key::Enter, Key::Up, Key::Down, Key::Left, Key::Right };
+
+	uint8_t pad = 0;
+	for (int i = 0; i < 8; i++)
+	{
+		if (Key::isKeyPressed(buttons[i]))
+			pad |= 1 << i;
+	}
+	return pad;
+}
+
+void NesScreen::runFrame(uint8_t pad, bool fastForward)
+{
+	sf::Clock clock;
+	//a playing movie overwrites the pads, a recording one takes them as they are
+	bus.controller[0] = pad;
+	movie.frame(bus);
+
+	if (runAhead == 0 || fastForward)
+	{
+		timeTravel.runFrame();
+		rewindBuffer.push(bus);
+		frameMs += (clock.getElapsedTime().asMicroseconds() / 1000.0f - frameMs) * 0.05f;
+		runAheadMs = 0.0f;
+		return;
+	}
+
+	//the real frame is never shown, only the one runAhead frames past it, then the real state comes back.
+	//Only the real frame is heard, the frames past it would play ahead of time and then again for real.
+	bus.ppu.setRendering(false);
+	timeTravel.runFrame();
+	rewindBuffer.push(bus);
+	frameMs += (clock.restart().asMicroseconds() / 1000.0f - frameMs) * 0.05f;
+
+	bus.saveState(runAheadState);
+	bus.apu.setOutput(false);
+	for (unsigned i = 1; i < runAhead; i++)
+		bus.runFrame();
+	bus.ppu.setRendering(true);
+	bus.runFrame();
+	bus.loadState(runAheadState);
+	bus.apu.setOutput(true);
+	runAheadMs += (clock.getElapsedTime().asMicroseconds() / 1000.0f - runAheadMs) * 0.05f;
+}
+
+void NesScreen::queueAudio()
+{
+	samples.resize(bus.apu.samplesAvailable());
+	samples.resize(bus.apu.readSamples(samples.data(), samples.size()));
+	audio.push(samples.data(), samples.size());
+}
+
+void NesScreen::capture(Frame& frame)
+{
+	//debugger steps stop anywhere in a frame, the ppu thread has to catch up before the ppu is read
+	bus.syncPpu();
+	const uint8_t* pixels = bus.ppu.getFrameBuffer();
+	if (pixels != nullptr)
+		std::copy(pixels, pixels + frame.pixels.size(), frame.pixels.begin());
+	frame.position = bus.getClockCounter();
+	frame.a = bus.cpu.reg_a;
+	frame.x = bus.cpu.reg_x;
+	frame.y = bus.cpu.reg_y;
+	frame.sp = bus.cpu.sp;
+	frame.status = bus.cpu.status_reg;
+	frame.pc = bus.cpu.pc;
+	frame.codeLines = disassembly.window(bus.cpu.pc, CODE_BEFORE, frame.code, CODE_LINES);
+	frame.movieMode = movie.mode();
+	frame.moviePosition = movie.framePosition();
+	frame.movieFrames = movie.frameCount();
+	frame.frameMs = frameMs;
+	frame.runAheadMs = runAheadMs;
+	frame.pace = pacer.stats();
+	frame.fastForward = pacer.isUnlimited();
+	frame.ppuThread = bus.hasPpuThread();
+	VramViewer::capture(bus.ppu, frame.vram, ++vramSequence);
+
+	frame.hotSpots = 0;
+	if (profiler)
+	{
+		Profiler::HotSpot spots[HOT_SPOTS];
+		frame.hotSpots = profiler->hotSpots(spots, HOT_SPOTS);
+		double total = double(profiler->instructionCount());
+		for (size_t i = 0; i < frame.hotSpots; i++)
+		{
+			disassembly.window(spots[i].pc, 0, &frame.hotLines[i], 1);
+			frame.hotShares[i] = float(spots[i].hits * 100.0 / total);
+		}
+	}
+}
+
+void NesScreen::emulate()
+{
+	while (true)
+	{
+		bool publish = true;
+		{
+			std::unique_lock<std::mutex> lock(busLock);
+			if (stepMode)
+			{
+				wake.wait(lock, [this] { return quit || !stepMode; });
+				pacer.reset();
+			}
+			if (quit)
+				return;
+
+			//holding tab runs uncapped and silent, rendering one frame in FAST_FORWARD_SKIP and skipping the ppu output of the rest
+			uint16_t keys = input.load(std::memory_order_relaxed);
+			bool fastForward = (keys & INPUT_FAST_FORWARD) != 0;
+			pacer.setUnlimited(fastForward);
+			publish = !fastForward || ++fastForwardFrames % FAST_FORWARD_SKIP == 0;
+			bus.syncPpu();
+			bus.ppu.setRendering(publish);
+			bus.apu.setOutput(!fastForward);
+
+			//holding backspace plays the recorded frames backwards, not while a movie runs since it would desync it
+			if ((keys & INPUT_REWIND) && movie.mode() == InputMovie::Mode::Idle)
+				rewindBuffer.rewind(bus);
+			else
+				runFrame(uint8_t(keys), fastForward);
+
+			bus.ppu.setRendering(true);
+			bus.apu.setOutput(true);
+			queueAudio();
+			if (publish)
+				capture(frames.writeBuffer());
+		}
+		if (publish)
+			frames.publish();
+
+		pacer.wait();
+	}
 }
 
 void NesScreen::renderScreen()
 {
-	sf::Image buffer = bus.ppu.getScreenBuffer();
-	sf::Texture texture;
-	texture.loadFromImage(buffer);
-	sf::Sprite screen;
-	screen.setTexture(texture, true);
-	screen.setScale(2, 2);
+	//the published frames are the second pixel buffer, the emulation thread already writes the next
+	//one into its own slot while this one is converted and uploaded
+	if (shown->position != uploadedPosition)
+	{
+		const uint8_t* frame = shown->pixels.data();
+		for (size_t i = 0; i < shown->pixels.size(); i++)
+			std::memcpy(&screenPixels[i * 4], nes2c02::ppuPalette[frame[i]], 4);
+		screenTexture.update(screenPixels.data());
+		uploadedPosition = shown->position;
+	}
+
 	window.draw(screen);
 }
 
-void NesScreen::renderCode()
+void NesScreen::renderCode(float top)
 {
-	sf::Text text("", font, 16);
-	text.setPosition(650, 120);
-	auto it = image.find(bus.cpu.pc);
-	for (int i = 0; i < 7 && it != image.begin(); i++)
-		--it;
+	float y = std::max(top, 136.0f);
+	for (size_t i = 0; i < shown->codeLines; i++)
+	{
+		const Disassembly::Line& line = shown->code[i];
+		sf::Color color = sf::Color::White;
+		if (line.address == shown->pc)
+			color = sf::Color::Green;
+		else if (timeTravel.isBreakpoint(line.address))
+			color = sf::Color::Red;
+		appendText(Disassembly::format(line), TEXT_X, y, color);
+		y += TEXT_SIZE;
+	}
+}
 
-	for (int i = 0; i < 20 && it != image.end(); i++)
+void NesScreen::renderHotSpots(float top)
+{
+	if (!profiler)
+		return;
+	float y = appendText("Hot spots", 0, std::max(top, 136.0f), sf::Color::Yellow);
+	for (size_t i = 0; i < shown->hotSpots; i++)
 	{
-		if (it->first == bus.cpu.pc)
-			text.setFillColor(sf::Color::Green);
-		else
-			text.setFillColor(sf::Color::White);
-		text.setString(it->second);
-		text.setPosition(650, text.getPosition().y + 16);
-		window.draw(text);
-		it++;
+		const Disassembly::Line& line = shown->hotLines[i];
+		std::string name = line.data ? ".db" : std::string(nes6502::opcodeName(line.bytes[0]));
+		appendText(hex(line.address) + " " + name + " " + std::to_string(shown->hotShares[i]).substr(0, 4) + "%", 0, y,
+			line.address == shown->pc ? sf::Color::Green : sf::Color::White);
+		y += TEXT_SIZE;
 	}
 }
 
+void NesScreen::renderPanel()
+{
+	//timings and audio counters change every frame, they are only looked at a few times a second
+	if (statsClock.getElapsedTime() >= sf::milliseconds(250))
+	{
+		statsClock.restart();
+		std::string text = "Run-ahead: " + std::to_string(runAhead) + " (" + std::to_string(shown->frameMs).substr(0, 4) + " ms +" + std::to_string(shown->runAheadMs).substr(0, 4) + " ms)" +
+			(shown->fastForward ? "\nFast-forward: " : "\nFrame: ") + std::to_string(shown->pace.meanMs).substr(0, 5) + " ms, jitter " +
+			std::to_string(shown->pace.jitterMs).substr(0, 4) + "\nWorst: " + std::to_string(shown->pace.worstMs).substr(0, 4) + " ms, late " + std::to_string(shown->pace.late) +
+			"\nAudio: " + std::to_string(audio.fillMs()).substr(0, 4) + " ms, rate " + std::to_string(audio.rateAdjust()).substr(0, 6) +
+			"\nUnderruns: " + std::to_string(audio.underrunCount()) + " Overruns: " + std::to_string(audio.overrunCount()) +
+			(shown->ppuThread ? "\nPPU: own thread" : "\nPPU: emulation thread");
+		if (text != stats)
+		{
+			stats = text;
+			panelDirty = true;
+		}
+	}
+
+	//a new position means new registers and maybe a new disassembly window, commands and stats set panelDirty
+	if (panelDirty || shown->position != panelPosition)
+	{
+		panelText.clear();
+		float top = renderRegisters();
+		renderCode(top);
+		renderHotSpots(top);
+		panel.clear(BACKGROUND);
+		//the glyphs are added to the font texture as they are first used, so it is fetched after the text is built
+		panel.draw(panelText, sf::RenderStates(&font.getTexture(TEXT_SIZE)));
+		panel.display();
+		panelPosition = shown->position;
+		panelDirty = false;
+	}
+
+	window.draw(panelSprite);
+}
+
 void NesScreen::renderNametables()
-{}
+{
+	if (!showVram)
+		return;
+	//a frame seen before decodes nothing, but the heat still fades while it is shown
+	vramViewer.update(shown->vram);
+	vramViewer.draw(window, 0, float(2 * nes2c02::SCREEN_HEIGHT), vramHeat);
+}
 
 NesScreen::NesScreen(std::string cartridgePath)
-	:window(sf::VideoMode(900, 600), "NES Emu"), cart(std::make_shared<Cartridge>(cartridgePath))
+	:window(sf::VideoMode(900, 600), "NES Emu"), timeTravel(bus), disassembly(bus), audio(AudioOutput::OUTPUT_RATE), cart(std::make_shared<Cartridge>(cartridgePath)),
+	frames(Frame{ std::vector<uint8_t>(nes2c02::SCREEN_WIDTH * nes2c02::SCREEN_HEIGHT) }), stepFrame(frames.readBuffer()), shown(&stepFrame)
 {}
 
+NesScreen::~NesScreen()
+{
+	{
+		std::lock_guard<std::mutex> lock(busLock);
+		quit = true;
+	}
+	wake.notify_one();
+	if (emulation.joinable())
+		emulation.join();
+}
+
 void NesScreen::init()
 {
 	font.loadFromFile("..\\res\\consola.ttf");
+	screenTexture.create(nes2c02::SCREEN_WIDTH, nes2c02::SCREEN_HEIGHT);
+	screenPixels.assign(nes2c02::SCREEN_WIDTH * nes2c02::SCREEN_HEIGHT * 4, 0);
+	screen.setTexture(screenTexture, true);
+	screen.setScale(2, 2);
+	panel.create(PANEL_WIDTH, 600);
+	panelSprite.setTexture(panel.getTexture(), true);
+	panelSprite.setPosition(float(PANEL_X), 0);
+	vramViewer.create();
+	if constexpr (Profiler::ENABLED)
+	{
+		profiler = std::make_unique<Profiler>();
+		bus.setProfiler(profiler.get());
+	}
 	bus.insertCartridge(cart);
-	image = bus.cpu.dissamble(0xc000, 0xFFFF);
 	bus.reset();
+	//the code view shows what the analysis never reached as data
+	codeMap.analyze(*cart, workers);
+	disassembly.setCodeMap(&codeMap);
+	debugInfo = "Code map: " + std::to_string(codeMap.instructionCount()) + " instructions, " + std::to_string(codeMap.blockCount()) + " blocks";
+	//the emulation thread only logs the frame, its lines are drawn on the pool while it runs vblank
+	bus.ppu.setDeferredRendering(true, &workers);
+	bus.apu.setSampleRate(AudioOutput::OUTPUT_RATE);
+	audio.play();
+	//the emulation thread no longer paces the window, vsync keeps it from spinning
+	window.setVerticalSyncEnabled(true);
+	emulation = std::thread(&NesScreen::emulate, this);
+}
+
+void NesScreen::handleKey(sf::Keyboard::Key key)
+{
+	//every command works on the machine, it waits for the frame the emulation thread is on
+	std::lock_guard<std::mutex> lock(busLock);
+	if (key == sf::Keyboard::Space)
+	{
+		timeTravel.step();
+	}
+	else if (key == sf::Keyboard::A)
+	{
+		for (int i = 0; i < 256; i++)
+		{
+			timeTravel.clock();
+		}
+	}
+	else if (key == sf::Keyboard::T)
+	{
+		uint16_t addr = bus.cpu.pc;
+		while (!(bus.cpu.pc > addr))
+			timeTravel.clock();
+	}
+	else if (key == sf::Keyboard::Z)
+	{
+		debugInfo = timeTravel.reverseStep() ? "" : "No earlier instruction recorded";
+	}
+	else if (key == sf::Keyboard::X)
+	{
+		debugInfo = timeTravel.reverseContinue() ? "" : "No earlier breakpoint hit";
+	}
+	else if (key == sf::Keyboard::B)
+	{
+		timeTravel.toggleBreakpoint(bus.cpu.pc);
+	}
+	else if (key == sf::Keyboard::W)
+	{
+		uint16_t addr = bus.cpu.getEffectiveAddress();
+		auto write = timeTravel.lastWrite(addr);
+		debugInfo = "$" + hex(addr) + (write.found ? " last written by $" + hex(write.pc) + ",\n" +
+			std::to_string(bus.getClockCounter() - write.position) + " dots ago" : " not written in history");
+	}
+	else if (key == sf::Keyboard::P)
+	{
+		writeImage("out.txt");
+		debugInfo = "Wrote out.txt";
+	}
+	else if (key == sf::Keyboard::R)
+	{
+		bus.reset();
+	}
+	else if (key == sf::Keyboard::D)
+	{
+		stepMode = !stepMode;
+	}
+	else if (key == sf::Keyboard::PageUp && runAhead < MAX_RUN_AHEAD)
+	{
+		runAhead++;
+	}
+	else if (key == sf::Keyboard::PageDown && runAhead > 0)
+	{
+		runAhead--;
+	}
+	else if (key == sf::Keyboard::F5)
+	{
+		//F5 starts recording from power-on, and stops and saves on the second press
+		if (movie.mode() == InputMovie::Mode::Recording)
+		{
+			movie.stop();
+			debugInfo = movie.save("movie.nesm") ? "Saved movie.nesm" : "Could not save movie.nesm";
+		}
+		else
+		{
+			movie.record(bus);
+			rewindBuffer.clear();
+			stepMode = false;
+			debugInfo = "";
+		}
+	}
+	else if (key == sf::Keyboard::F6)
+	{
+		//F6 plays movie.nesm from power-on, or stops playback
+		if (movie.mode() == InputMovie::Mode::Playing)
+			movie.stop();
+		else if (movie.mode() == InputMovie::Mode::Idle && movie.load("movie.nesm") && movie.play(bus))
+		{
+			rewindBuffer.clear();
+			stepMode = false;
+			debugInfo = "";
+		}
+		else if (movie.mode() == InputMovie::Mode::Idle)
+			debugInfo = "No movie.nesm for this rom";
+	}
+	else if (key == sf::Keyboard::F8)
+	{
+		if (!profiler)
+			debugInfo = "Built without NES_PROFILE";
+		else
+			debugInfo = profiler->saveJson("profile.json") ? "Saved profile.json" : "Could not save profile.json";
+	}
+	else if (key == sf::Keyboard::F9 && profiler)
+		profiler->clear();
+	else if (key == sf::Keyboard::N)
+		showVram = !showVram;
+	else if (key == sf::Keyboard::H)
+		vramHeat = !vramHeat;
+	else if (key == sf::Keyboard::F7)
+	{
+		//F7 moves the ppu to a thread of its own and back, the frame time on the panel compares the two
+		bus.setPpuThread(!bus.hasPpuThread());
+	}
+	//D, F5 and F6 can leave step mode
+	wake.notify_one();
+	panelDirty = true;
+}
+
+void NesScreen::handleEvent(const sf::Event& event)
+{
+	if (event.type == sf::Event::Closed)
+		window.close();
+	else if (event.type == sf::Event::KeyPressed)
+		handleKey(event.key.code);
+	//anything else (mouse moves, key releases) leaves the picture as it is
+	else if (event.type != sf::Event::Resized && event.type != sf::Event::GainedFocus)
+		return;
+	redraw = true;
 }
 
 bool NesScreen::update()
 {
+	//while paused only an event can change anything, so sleep in the event queue instead of drawing
 	sf::Event event;
+	if (stepMode && !redraw && window.waitEvent(event))
+		handleEvent(event);
 	while (window.pollEvent(event))
+		handleEvent(event);
+
+	input.store(readPad() | (sf::Keyboard::isKeyPressed(sf::Keyboard::Backspace) ? INPUT_REWIND : 0) |
+		(sf::Keyboard::isKeyPressed(sf::Keyboard::Tab) ? INPUT_FAST_FORWARD : 0), std::memory_order_relaxed);
+	if (stepMode)
 	{
-		if (event.type == sf::Event::Closed)
-			window.close();
-		else if (event.type == sf::Event::KeyPressed)
+		if (redraw)
 		{
-			if (event.key.code == sf::Keyboard::Space)
-			{
-				uint16_t pc_prev = bus.cpu.pc;
-				while (pc_prev == bus.cpu.pc)
-					bus.clock();
-			}
-			else if (event.key.code == sf::Keyboard::A)
-			{
-				for (int i = 0; i < 256; i++)
-				{
-					bus.clock();
-				}
-			}
-			else if (event.key.code == sf::Keyboard::T)
-			{
-				uint16_t addr = bus.cpu.pc;
-				while (!(bus.cpu.pc > addr))
-					bus.clock();
-			}
-			else if (event.key.code == sf::Keyboard::R)
-			{
-				bus.reset();
-			}
-			else if (event.key.code == sf::Keyboard::D)
-			{
-				stepMode = !stepMode;
-			}
+			//the emulation thread is asleep, take the frame straight from the bus
+			std::lock_guard<std::mutex> lock(busLock);
+			queueAudio();
+			capture(stepFrame);
+			shown = &stepFrame;
 		}
 	}
-	window.clear({ 52,52,52,255 });
+	else if (frames.update())
+	{
+		shown = &frames.readBuffer();
+		redraw = true;
+	}
 
-	if (!stepMode)
+	if (!redraw)
 	{
-		bus.ppu.frame_complete = false;
-		while (!bus.ppu.frame_complete)
-			bus.clock();
+		//running but no new frame yet, vsync doesn't pace a loop that doesn't present
+		if (!stepMode)
+			sf::sleep(sf::milliseconds(1));
+		return window.isOpen();
 	}
 
-	renderRegisters();
+	window.clear(BACKGROUND);
 	renderScreen();
-	renderCode();
+	renderPanel();
 	renderNametables();
 
 	window.display();
+	redraw = false;
 	return window.isOpen();
 }
 
-void NesScreen::printImage(std::string filename)
+void NesScreen::writeImage(const std::string& filename)
 {
 	std::ofstream file(filename);
-	auto it = image.find(0xc000);
-
-	while (it != image.end())
-	{
-		uint8_t data = bus.cpuRead(it->first);
-		// if (data == 0)
-		// {
-		// 	file << "0x" << hex(it->first) << ": [0x00]\n";
-		// 	while (data == 0)
-		// 	{
-		// 		data = bus.cpuRead(it->first);
-		// 		it++;
-		// 	}
-		// }
-		// else if (data == 0xFF)
-		// {
-		// 	file << "0x" << hex(it->first) << ": [0xFF]\n";
-		// 	while (data == 0xFF)
-		// 	{
-		// 		data = bus.cpuRead(it->first);
-		// 		it++;
-		// 	}
-		// 	file << it->second << "\n";
-		// }
-		// else
-		file << it->second << "\n";
-		it++;
-	}
-
-	file.close();
+	Disassembly::Line line;
+	for (uint32_t addr = 0xC000; addr < 0xFFFE; addr += Disassembly::instructionLength(line.bytes[0]))
+	{
+		disassembly.window(uint16_t(addr), 0, &line, 1);
+		file << Disassembly::format(line) << "\n";
+	}
+}
+
+void NesScreen::printImage(std::string filename)
+{
+	std::lock_guard<std::mutex> lock(busLock);
+	writeImage(filename);
 }
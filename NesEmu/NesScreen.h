@@ -1,29 +1,164 @@
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <SFML/Graphics.hpp>
 
+#include "AudioOutput.h"
 #include "Bus.h"
+#include "CodeMap.h"
+#include "Disassembly.h"
+#include "FramePacer.h"
+#include "InputMovie.h"
+#include "Profiler.h"
+#include "RewindBuffer.h"
+#include "ThreadPool.h"
+#include "TimeTravel.h"
+#include "TripleBuffer.h"
+#include "VramViewer.h"
 
+//The window runs on the thread that calls update(), the emulation on a thread of its own.
+//While running, the emulation thread publishes a Frame after every emulated frame through a triple
+//buffer and takes the pads from an atomic snapshot, so a slow present never holds up emulation
+//and emulation never holds up the window. Debugger commands take busLock and so wait for at most
+//the frame in progress. In step mode the emulation thread sleeps and the window reads the bus itself.
 class NesScreen
 {
+public:
+	//NTSC frame rate, the emulation thread runs at this pace
+	static constexpr double FRAME_RATE = 60.0988;
+	//while fast-forwarding only every Nth frame is rendered and published
+	static constexpr unsigned FAST_FORWARD_SKIP = 8;
+
 private:
+	//what the window shows of one frame, so it never has to touch the bus while emulation runs
+	//code view: lines shown, and how many of them come before pc
+	static constexpr size_t CODE_LINES = 20;
+	static constexpr size_t CODE_BEFORE = 7;
+	//profiler view: the most run instructions, left of the code
+	static constexpr size_t HOT_SPOTS = 16;
+
+	struct Frame
+	{
+		std::vector<uint8_t> pixels;
+		//clock counter the frame was taken at, a new one means the pixels may have changed
+		size_t position;
+		uint8_t a, x, y, sp, status;
+		uint16_t pc;
+		Disassembly::Line code[CODE_LINES];
+		size_t codeLines;
+		InputMovie::Mode movieMode;
+		size_t moviePosition, movieFrames;
+		float frameMs, runAheadMs;
+		FramePacer::Stats pace;
+		bool fastForward, ppuThread;
+		VramViewer::Snapshot vram;
+		//share of all profiled instructions in percent, nothing without a profiler
+		Disassembly::Line hotLines[HOT_SPOTS];
+		float hotShares[HOT_SPOTS];
+		size_t hotSpots;
+	};
+
+	//input snapshot bits above the pad byte
+	static constexpr uint16_t INPUT_REWIND = 0x100;
+	static constexpr uint16_t INPUT_FAST_FORWARD = 0x200;
+
 	sf::RenderWindow window;
+	//code map analysis and the ppu's deferred line rendering, declared before bus so it outlives its frames
+	ThreadPool workers;
 	Bus bus;
+	RewindBuffer rewindBuffer;
+	TimeTravel timeTravel;
+	CodeMap codeMap;
+	Disassembly disassembly;
+	InputMovie movie;
+	//only in builds with NES_PROFILE, F8 writes it to profile.json and F9 starts it over
+	std::unique_ptr<Profiler> profiler;
+	AudioOutput audio;
+	std::vector<int16_t> samples;
+	std::string debugInfo;
 	std::shared_ptr<Cartridge> cart;
-	std::map<uint16_t, std::string> image;
 	sf::Font font;
+	//the screen texture lives as long as the window and is only written when shown->position moves
+	sf::Texture screenTexture;
+	sf::Sprite screen;
+	std::vector<uint8_t> screenPixels;
+	size_t uploadedPosition = SIZE_MAX;
+	//name and pattern tables under the screen, N hides them and H shows what the ppu wrote lately
+	VramViewer vramViewer;
+	bool showVram = true;
+	bool vramHeat = false;
+	//counts vram snapshots, written under busLock
+	uint64_t vramSequence = 0;
+	//registers and disassembly are drawn as one vertex array into panel, which is only redrawn when
+	//the shown position moves, a command ran or the stats line changed
+	static constexpr unsigned TEXT_SIZE = 16;
+	static constexpr unsigned PANEL_X = 520;
+	static constexpr unsigned PANEL_WIDTH = 380;
+	//registers and code start here, the hot spots take the column left of them
+	static constexpr float TEXT_X = 130.0f;
+	//the panel is opaque in the window's color, text antialiased onto a transparent target blends badly
+	inline static const sf::Color BACKGROUND{ 52, 52, 52, 255 };
+	sf::RenderTexture panel;
+	sf::Sprite panelSprite;
+	sf::VertexArray panelText{ sf::Quads };
+	size_t panelPosition = SIZE_MAX;
+	bool panelDirty = true;
+	sf::Clock statsClock;
+	std::string stats;
 	bool stepMode = true;
+	//the window is only drawn again when a new frame came in or an event changed something
+	bool redraw = true;
+
+	//frames emulated past the real state before drawing, each hides one frame of input latency
+	static constexpr unsigned MAX_RUN_AHEAD = 8;
+	unsigned runAhead = 0;
+	std::vector<uint8_t> runAheadState;
+	//smoothed cpu time per host frame, split so the cost of the run-ahead can be shown
+	float frameMs = 0.0f;
+	float runAheadMs = 0.0f;
+	FramePacer pacer{ FRAME_RATE };
+	unsigned fastForwardFrames = 0;
 
-	void renderRegisters();
+	//everything above is the emulation thread's while it runs, the window thread takes busLock to touch it
+	std::thread emulation;
+	std::mutex busLock;
+	std::condition_variable wake;
+	bool quit = false;
+	std::atomic<uint16_t> input{ 0 };
+	TripleBuffer<Frame> frames;
+	//what the window draws, the newest published frame or a capture taken in step mode
+	Frame stepFrame;
+	const Frame* shown = nullptr;
+
+	void emulate();
+	//pad 1 from the keyboard: arrows, K = A, J = B, right shift = Select, enter = Start
+	uint8_t readPad();
+	//fast-forward frames skip the run-ahead, their output is thrown away anyway
+	void runFrame(uint8_t pad, bool fastForward);
+	//hands the samples the apu made since the last call to the audio thread
+	void queueAudio();
+	void capture(Frame& frame);
+	void handleEvent(const sf::Event& event);
+	void handleKey(sf::Keyboard::Key key);
+	//the code from $C000 up as text, the caller holds busLock
+	void writeImage(const std::string& filename);
+	//appends text at x, y to panelText and returns the y below its last line
+	float appendText(const std::string& text, float x, float y, sf::Color color);
+	float renderRegisters();
 	void renderScreen();
-	void renderCode();
+	void renderCode(float top);
+	void renderHotSpots(float top);
+	void renderPanel();
 	void renderNametables();
 public:
 	NesScreen(std::string cartridgePath);
+	~NesScreen();
 
 	void init();
 	bool update();
 	void printImage(std::string filename);
 };
-
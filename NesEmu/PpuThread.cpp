@@ -0,0 +1,143 @@
+#include "PpuThread.h"
+#include "nes2c02.h"
+
+#include <algorithm>
+#include <chrono>
+
+PpuThread::PpuThread(nes2c02& ppu, uint64_t time)
+	:ppu(ppu), time(time)
+{
+	rebase(time);
+	thread = std::thread(&PpuThread::run, this);
+}
+
+PpuThread::~PpuThread()
+{
+	push({ 0, Kind::Stop, 0, 0 });
+	thread.join();
+}
+
+void PpuThread::run()
+{
+	Event batch[64];
+	uint64_t done = 0;
+	unsigned idle = 0;
+	while (true)
+	{
+		size_t count = events.pop(batch, 64);
+		if (count == 0)
+		{
+			//while the cpu runs an event comes every ADVANCE_DOTS, so a short spin usually finds it
+			if (++idle < 1000)
+			{
+				std::this_thread::yield();
+				continue;
+			}
+			//paused or between paced frames, push() wakes the thread, the timeout is only a safety net
+			std::unique_lock<std::mutex> guard(sleepLock);
+			sleeping.store(true);
+			if (events.size() == 0)
+				wake.wait_for(guard, std::chrono::milliseconds(50));
+			sleeping.store(false);
+			idle = 0;
+			continue;
+		}
+
+		idle = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			const Event& event = batch[i];
+			if (event.kind == Kind::Stop)
+				return;
+			if (event.kind == Kind::Rebase)
+				time = event.time;
+			for (; time < event.time; time++)
+				ppu.clock();
+
+			if (event.kind == Kind::Write)
+				ppu.cpuWrite(event.addr, event.data);
+			else if (event.kind == Kind::Read)
+				readData = ppu.cpuRead(event.addr);
+			//one at a time, a read is waited for and is the last event before the wait
+			processed.store(++done, std::memory_order_release);
+		}
+	}
+}
+
+void PpuThread::push(const Event& event)
+{
+	while (events.push(&event, 1) == 0)
+		std::this_thread::yield();
+	pushed++;
+
+	//the ring's release store and the sleeping check must not be reordered, or a sleep could miss this
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (sleeping.load())
+	{
+		std::lock_guard<std::mutex> guard(sleepLock);
+		wake.notify_one();
+	}
+}
+
+void PpuThread::waitProcessed()
+{
+	while (processed.load(std::memory_order_acquire) != pushed)
+		std::this_thread::yield();
+}
+
+bool PpuThread::checkDot(uint64_t time)
+{
+	bool nmi = false;
+	if (time == nextNmi)
+	{
+		nmi = nmiEnabled;
+		nextNmi += FRAME_DOTS;
+	}
+	if (time >= nextAdvance)
+	{
+		push({ time, Kind::Advance, 0, 0 });
+		nextAdvance = time + ADVANCE_DOTS;
+	}
+	nextCheck = std::min(nextNmi, nextAdvance);
+	return nmi;
+}
+
+void PpuThread::write(uint64_t time, uint8_t addr, uint8_t data)
+{
+	//the ppu raises nmi from what $2000 holds on the nmi dot, the shadow has to follow it
+	if (addr == 0x0000)
+		nmiEnabled = (data & 0x80) != 0;
+	push({ time, Kind::Write, addr, data });
+}
+
+uint8_t PpuThread::read(uint64_t time, uint8_t addr)
+{
+	push({ time, Kind::Read, addr, 0 });
+	waitProcessed();
+	return readData;
+}
+
+uint64_t PpuThread::frameEnd(uint64_t time)
+{
+	while (nextFrameEnd <= time)
+		nextFrameEnd += FRAME_DOTS;
+	return nextFrameEnd;
+}
+
+void PpuThread::sync(uint64_t time)
+{
+	push({ time, Kind::Advance, 0, 0 });
+	waitProcessed();
+}
+
+void PpuThread::rebase(uint64_t time)
+{
+	//the ppu is synced, so its position can be read to predict from
+	uint64_t dot = ppu.frameDot();
+	nextFrameEnd = time + (FRAME_DOTS - dot);
+	nextNmi = time + (NMI_DOT + FRAME_DOTS - dot) % FRAME_DOTS;
+	nmiEnabled = ppu.nmiEnabled();
+	nextAdvance = time + ADVANCE_DOTS;
+	nextCheck = std::min(nextNmi, nextAdvance);
+	push({ time, Kind::Rebase, 0, 0 });
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#include "SpscRing.h"
+
+class nes2c02;
+
+//Runs a nes2c02 on a thread of its own, fed by the cpu thread through one ordered event queue.
+//Every event carries the ppu dot it happens on: run up to a dot, a register write, a register read
+//or a jump in time after the ppu was changed directly. The cpu thread only waits on reads, which
+//need the ppu to have caught up, and on sync(). Nmi and frame ends are not waited for: the frame
+//has a fixed length, so the cpu side predicts them from the dot and a shadow of the nmi enable bit.
+//Only cartridges whose chr mapping the cpu can't change are safe, their chr is read by both threads.
+class PpuThread
+{
+public:
+	//dots in a frame, nes2c02 skips dot 0 of line 0 on every frame
+	static constexpr uint64_t FRAME_DOTS = 341 * 262 - 1;
+	//frameDot() of the dot that raises nmi, scanline 241 dot 1
+	static constexpr uint64_t NMI_DOT = 341 + 340 + 240 * 341 + 1;
+	//the cpu side hands the ppu a new target this often when it has nothing else to say
+	static constexpr uint64_t ADVANCE_DOTS = 256;
+
+private:
+	enum class Kind : uint8_t
+	{
+		Advance,
+		Write,
+		Read,
+		Rebase,
+		Stop
+	};
+
+	struct Event
+	{
+		uint64_t time;
+		Kind kind;
+		uint8_t addr, data;
+	};
+
+	nes2c02& ppu;
+	SpscRing<Event> events{ 4096 };
+	std::thread thread;
+
+	//ppu thread: dots run since reset, events done and the last read's result
+	uint64_t time = 0;
+	alignas(64) std::atomic<uint64_t> processed{ 0 };
+	uint8_t readData = 0;
+	//the ppu thread sleeps here after spinning a while without events
+	std::atomic<bool> sleeping{ false };
+	std::mutex sleepLock;
+	std::condition_variable wake;
+
+	//cpu thread
+	alignas(64) uint64_t pushed = 0;
+	uint64_t nextAdvance = 0;
+	uint64_t nextNmi = 0;
+	//dot count the frame being drawn ends at
+	uint64_t nextFrameEnd = 0;
+	bool nmiEnabled = false;
+	//min(nextAdvance, nextNmi), the only dots dot() has to look at
+	uint64_t nextCheck = 0;
+
+	void run();
+	void push(const Event& event);
+	//waits until the ppu thread has done every event pushed
+	void waitProcessed();
+	bool checkDot(uint64_t time);
+
+public:
+	//takes over ppu, which must not be touched by anyone else until sync()
+	PpuThread(nes2c02& ppu, uint64_t time);
+	~PpuThread();
+
+	PpuThread(const PpuThread&) = delete;
+	PpuThread& operator=(const PpuThread&) = delete;
+
+	//cpu side, once per dot in order before it runs: true on the dot that raises nmi
+	bool dot(uint64_t time) { return time >= nextCheck && checkDot(time); }
+	//register accesses, time is the number of dots the ppu has run when they happen
+	void write(uint64_t time, uint8_t addr, uint8_t data);
+	uint8_t read(uint64_t time, uint8_t addr);
+	//dot count the frame that dot time is in ends at
+	uint64_t frameEnd(uint64_t time);
+
+	//runs the ppu to time and waits for it, the ppu may then be used directly until the next event
+	void sync(uint64_t time);
+	//after the synced ppu was changed directly, time is the dot count it is now at
+	void rebase(uint64_t time);
+};
@@ -0,0 +1,100 @@
+#include "Profiler.h"
+#include "Common.h"
+#include "nes6502.h"
+
+#include <algorithm>
+#include <fstream>
+
+namespace
+{
+	const char* const REGION_NAMES[Profiler::REGIONS] = { "ram", "ppuRegisters", "io", "cartridge", "unmapped" };
+}
+
+Profiler::Profiler()
+	:pcHits(0x10000, 0)
+{}
+
+void Profiler::clear()
+{
+	std::fill(std::begin(opcodeCounts), std::end(opcodeCounts), 0);
+	std::fill(std::begin(opcodeCycles), std::end(opcodeCycles), 0);
+	std::fill(pcHits.begin(), pcHits.end(), 0);
+	std::fill(std::begin(reads), std::end(reads), 0);
+	std::fill(std::begin(writes), std::end(writes), 0);
+}
+
+uint64_t Profiler::instructionCount() const
+{
+	uint64_t total = 0;
+	for (uint64_t count : opcodeCounts)
+		total += count;
+	return total;
+}
+
+uint64_t Profiler::cycleCount() const
+{
+	uint64_t total = 0;
+	for (uint64_t cycles : opcodeCycles)
+		total += cycles;
+	return total;
+}
+
+size_t Profiler::hotSpots(HotSpot* out, size_t count) const
+{
+	//insertion into the short sorted list, a pc that misses its last entry costs one compare
+	size_t filled = 0;
+	for (uint32_t pc = 0; pc < 0x10000 && count > 0; pc++)
+	{
+		uint64_t hits = pcHits[pc];
+		if (hits == 0 || (filled == count && hits <= out[count - 1].hits))
+			continue;
+
+		size_t i = filled < count ? filled++ : count - 1;
+		for (; i > 0 && out[i - 1].hits < hits; i--)
+			out[i] = out[i - 1];
+		out[i] = { uint16_t(pc), hits };
+	}
+	return filled;
+}
+
+void Profiler::writeJson(std::ostream& out) const
+{
+	out << "{\n  \"instructions\": " << instructionCount() << ",\n  \"cycles\": " << cycleCount() << ",\n  \"opcodes\": [";
+	bool first = true;
+	for (int opcode = 0; opcode < 256; opcode++)
+	{
+		if (opcodeCounts[opcode] == 0)
+			continue;
+		out << (first ? "\n" : ",\n") << "    { \"opcode\": \"" << hex(uint8_t(opcode)) << "\", \"name\": \"" << nes6502::opcodeName(uint8_t(opcode)) <<
+			"\", \"count\": " << opcodeCounts[opcode] << ", \"cycles\": " << opcodeCycles[opcode] << " }";
+		first = false;
+	}
+
+	out << "\n  ],\n  \"pcs\": [";
+	first = true;
+	for (uint32_t pc = 0; pc < 0x10000; pc++)
+	{
+		if (pcHits[pc] == 0)
+			continue;
+		out << (first ? "\n" : ",\n") << "    { \"pc\": \"" << hex(uint16_t(pc)) << "\", \"hits\": " << pcHits[pc] << " }";
+		first = false;
+	}
+
+	out << "\n  ],\n  \"bus\": {";
+	for (int write = 0; write < 2; write++)
+	{
+		const uint64_t* counts = write ? writes : reads;
+		out << (write ? ",\n" : "\n") << "    \"" << (write ? "writes" : "reads") << "\": {";
+		for (size_t region = 0; region < REGIONS; region++)
+			out << (region ? ", " : " ") << "\"" << REGION_NAMES[region] << "\": " << counts[region];
+		out << " }";
+	}
+	out << "\n  }\n}\n";
+}
+
+bool Profiler::saveJson(const std::string& path) const
+{
+	std::ofstream file(path);
+	writeJson(file);
+	return file.good();
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cinttypes>
+#include <ostream>
+#include <string>
+#include <vector>
+
+//Where the emulated cpu spends its time: instructions and cycles per opcode, instructions started
+//per pc, and cpu bus reads and writes per region. The cpu and bus only feed it when the build
+//defines NES_PROFILE, otherwise their hooks are empty and a Bus has no profiler to attach.
+//Counts are never rolled back, frames run for run-ahead or replayed after a state load count again.
+class Profiler
+{
+public:
+#ifdef NES_PROFILE
+	static constexpr bool ENABLED = true;
+#else
+	static constexpr bool ENABLED = false;
+#endif
+
+	enum class Region : uint8_t
+	{
+		Ram,
+		PpuRegisters,
+		//apu and pads, $4000-$401F
+		Io,
+		Cartridge,
+		Unmapped
+	};
+	static constexpr size_t REGIONS = 5;
+
+	struct HotSpot
+	{
+		uint16_t pc;
+		uint64_t hits;
+	};
+
+	//region of an address the cartridge did not claim
+	static Region region(uint16_t addr)
+	{
+		if (addr <= 0x1FFF)
+			return Region::Ram;
+		if (addr <= 0x3FFF)
+			return Region::PpuRegisters;
+		return addr <= 0x401F ? Region::Io : Region::Unmapped;
+	}
+
+private:
+	uint64_t opcodeCounts[256] = {};
+	uint64_t opcodeCycles[256] = {};
+	//one counter per address, 512 KB, so it is kept off the machine
+	std::vector<uint64_t> pcHits;
+	uint64_t reads[REGIONS] = {};
+	uint64_t writes[REGIONS] = {};
+
+public:
+	Profiler();
+
+	void instruction(uint16_t pc, uint8_t opcode, uint8_t cycles)
+	{
+		opcodeCounts[opcode]++;
+		opcodeCycles[opcode] += cycles;
+		pcHits[pc]++;
+	}
+	void read(Region region) { reads[size_t(region)]++; }
+	void write(Region region) { writes[size_t(region)]++; }
+
+	void clear();
+	uint64_t instructionCount() const;
+	uint64_t cycleCount() const;
+	//the count most started pcs, most hits first, returns how many were filled in
+	size_t hotSpots(HotSpot* out, size_t count) const;
+
+	//everything as one json object, only opcodes and pcs that ran are listed
+	void writeJson(std::ostream& out) const;
+	bool saveJson(const std::string& path) const;
+};
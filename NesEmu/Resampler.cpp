@@ -0,0 +1,92 @@
+#include "Resampler.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RESAMPLER_SSE
+#include <immintrin.h>
+#endif
+
+namespace
+{
+	constexpr double PI = 3.14159265358979323846;
+	//just under the output nyquist, the ratio only ever moves by a fraction of a percent
+	constexpr double CUTOFF = 0.45;
+
+	struct Kernel
+	{
+		alignas(16) float taps[Resampler::PHASES][Resampler::TAPS];
+
+		Kernel()
+		{
+			for (int phase = 0; phase < Resampler::PHASES; phase++)
+			{
+				double sum = 0.0;
+				double values[Resampler::TAPS];
+				for (int i = 0; i < Resampler::TAPS; i++)
+				{
+					//output sits between taps 3 and 4
+					double x = i - (Resampler::TAPS / 2 - 1) - double(phase) / Resampler::PHASES;
+					double sinc = x == 0.0 ? 1.0 : std::sin(2.0 * PI * CUTOFF * x) / (2.0 * PI * CUTOFF * x);
+					double w = (i + 1 - double(phase) / Resampler::PHASES) / Resampler::TAPS;
+					double window = 0.42 - 0.5 * std::cos(2.0 * PI * w) + 0.08 * std::cos(4.0 * PI * w);
+					values[i] = sinc * window;
+					sum += values[i];
+				}
+				for (int i = 0; i < Resampler::TAPS; i++)
+					taps[phase][i] = float(values[i] / sum);
+			}
+		}
+	};
+	const Kernel kernel;
+
+	float dot(const float* samples, const float* taps)
+	{
+#ifdef RESAMPLER_SSE
+		__m128 sum = _mm_mul_ps(_mm_loadu_ps(samples), _mm_load_ps(taps));
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(samples + 4), _mm_load_ps(taps + 4)));
+		sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+		sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+		return _mm_cvtss_f32(sum);
+#else
+		float sum = 0.0f;
+		for (int i = 0; i < Resampler::TAPS; i++)
+			sum += samples[i] * taps[i];
+		return sum;
+#endif
+	}
+}
+
+Resampler::Resampler()
+{
+	clear();
+}
+
+void Resampler::clear()
+{
+	input.assign(TAPS - 1, 0.0f);
+	position = 0.0;
+}
+
+void Resampler::process(const int16_t* in, size_t count, double step, std::vector<int16_t>& out)
+{
+	size_t history = input.size();
+	input.resize(history + count);
+	for (size_t i = 0; i < count; i++)
+		input[history + i] = in[i];
+
+	out.reserve(out.size() + size_t(count / step) + 2);
+	while (position + TAPS <= input.size())
+	{
+		size_t index = (size_t)position;
+		int phase = int((position - index) * PHASES);
+		float sample = dot(&input[index], kernel.taps[phase]);
+		out.push_back((int16_t)std::clamp(sample, -32768.0f, 32767.0f));
+		position += step;
+	}
+
+	size_t used = std::min((size_t)position, input.size());
+	input.erase(input.begin(), input.begin() + used);
+	position -= used;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cinttypes>
+#include <cstddef>
+#include <vector>
+
+//Mono 16-bit resampler with a freely changing ratio, for small corrections around a nominal rate.
+//Every output sample is an 8 tap windowed sinc over the input picked from 256 fractional phases,
+//the dot product is done with SSE where the build has it.
+class Resampler
+{
+public:
+	static constexpr int TAPS = 8;
+	static constexpr int PHASES = 256;
+
+private:
+	//input not used up yet as floats, the first TAPS - 1 are history from the previous call
+	std::vector<float> input;
+	//position of the next output sample in input, in input samples
+	double position = 0.0;
+
+public:
+	Resampler();
+
+	//step is input samples per output sample, output is appended to out
+	void process(const int16_t* in, size_t count, double step, std::vector<int16_t>& out);
+	void clear();
+};
@@ -0,0 +1,241 @@
+#include "RewindBuffer.h"
+#include "Bus.h"
+
+#include <cstring>
+
+namespace
+{
+	//Delta layout: repeated { uint16 unchanged, uint16 changed, changed bytes of old ^ new }.
+	//Most of a frame's state is unchanged, so the runs of equal bytes are what gets compressed away.
+	constexpr size_t MAX_RUN = 0xFFFF;
+
+	void appendRun(std::vector<uint8_t>& out, uint16_t unchanged, uint16_t changed)
+	{
+		uint8_t header[4];
+		std::memcpy(header, &unchanged, 2);
+		std::memcpy(header + 2, &changed, 2);
+		out.insert(out.end(), header, header + 4);
+	}
+
+	bool sameWord(const uint8_t* a, const uint8_t* b)
+	{
+		uint64_t x, y;
+		std::memcpy(&x, a, 8);
+		std::memcpy(&y, b, 8);
+		return x == y;
+	}
+
+	void encodeDelta(const uint8_t* base, const uint8_t* data, size_t size, std::vector<uint8_t>& out)
+	{
+		out.clear();
+		size_t pos = 0;
+		while (pos < size)
+		{
+			size_t unchanged = 0;
+			while (pos + unchanged + 8 <= size && unchanged + 8 <= MAX_RUN && sameWord(base + pos + unchanged, data + pos + unchanged))
+				unchanged += 8;
+			while (pos + unchanged < size && unchanged < MAX_RUN && base[pos + unchanged] == data[pos + unchanged])
+				unchanged++;
+
+			//a changed run only ends at 4 equal bytes, a shorter gap costs less kept as xor bytes than as a new header
+			size_t start = pos + unchanged;
+			size_t changed = 0;
+			size_t equal = 0;
+			while (start + changed < size && changed < MAX_RUN && equal < 4)
+			{
+				equal = base[start + changed] == data[start + changed] ? equal + 1 : 0;
+				changed++;
+			}
+			if (equal == 4)
+				changed -= equal;
+
+			appendRun(out, (uint16_t)unchanged, (uint16_t)changed);
+			size_t at = out.size();
+			out.resize(at + changed);
+			for (size_t i = 0; i < changed; i++)
+				out[at + i] = base[start + i] ^ data[start + i];
+			pos = start + changed;
+		}
+	}
+
+	void decodeDelta(const uint8_t* base, size_t size, const std::vector<uint8_t>& delta, std::vector<uint8_t>& out)
+	{
+		out.assign(base, base + size);
+		size_t pos = 0;
+		size_t in = 0;
+		while (in + 4 <= delta.size())
+		{
+			uint16_t unchanged, changed;
+			std::memcpy(&unchanged, delta.data() + in, 2);
+			std::memcpy(&changed, delta.data() + in + 2, 2);
+			in += 4;
+			pos += unchanged;
+			for (size_t i = 0; i < changed; i++)
+				out[pos + i] ^= delta[in + i];
+			pos += changed;
+			in += changed;
+		}
+	}
+}
+
+RewindBuffer::RewindBuffer(size_t memoryCap, unsigned snapshotInterval, unsigned keyframeInterval)
+	: memoryCap(memoryCap), snapshotInterval(snapshotInterval ? snapshotInterval : 1),
+	keyframeInterval(keyframeInterval ? keyframeInterval : 1), worker(&RewindBuffer::workerLoop, this)
+{}
+
+RewindBuffer::~RewindBuffer()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	workAdded.notify_all();
+	worker.join();
+}
+
+void RewindBuffer::push(const Bus& bus)
+{
+	if (++frameCounter < snapshotInterval)
+		return;
+	frameCounter = 0;
+
+	std::vector<uint8_t> raw;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		if (!spare.empty())
+		{
+			raw = std::move(spare.back());
+			spare.pop_back();
+		}
+	}
+
+	bus.saveState(raw);
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		pending.push_back(std::move(raw));
+	}
+	workAdded.notify_one();
+}
+
+void RewindBuffer::workerLoop()
+{
+	std::unique_lock<std::mutex> guard(lock);
+	while (true)
+	{
+		workAdded.wait(guard, [this] { return stopping || !pending.empty(); });
+		if (stopping)
+			return;
+
+		std::vector<uint8_t> raw = std::move(pending.front());
+		pending.pop_front();
+		busy = true;
+
+		guard.unlock();
+		Snapshot snapshot = encode(raw);
+		guard.lock();
+
+		historyBytes += snapshot.data.size();
+		history.push_back(std::move(snapshot));
+		trim();
+
+		busy = false;
+		if (raw.capacity() != 0)
+			spare.push_back(std::move(raw));
+		if (pending.empty())
+			workDone.notify_all();
+	}
+}
+
+size_t RewindBuffer::keyframeOf(size_t index) const
+{
+	while (!history[index].keyframe)
+		index--;
+	return index;
+}
+
+RewindBuffer::Snapshot RewindBuffer::encode(std::vector<uint8_t>& raw) const
+{
+	bool keyframe = history.empty();
+	size_t base = 0;
+	if (!keyframe)
+	{
+		base = keyframeOf(history.size() - 1);
+		keyframe = history.size() - base >= keyframeInterval || history[base].data.size() != raw.size();
+	}
+
+	Snapshot snapshot;
+	snapshot.keyframe = keyframe;
+	if (keyframe)
+		snapshot.data = std::move(raw);
+	else
+	{
+		encodeDelta(history[base].data.data(), raw.data(), raw.size(), snapshot.data);
+		snapshot.data.shrink_to_fit();
+	}
+	return snapshot;
+}
+
+void RewindBuffer::trim()
+{
+	while (historyBytes > memoryCap)
+	{
+		//never drop the group that is still being written to
+		size_t next = 1;
+		while (next < history.size() && !history[next].keyframe)
+			next++;
+		if (next == history.size())
+			return;
+
+		for (size_t i = 0; i < next; i++)
+		{
+			historyBytes -= history.front().data.size();
+			history.pop_front();
+		}
+	}
+}
+
+bool RewindBuffer::rewind(Bus& bus, size_t steps)
+{
+	std::unique_lock<std::mutex> guard(lock);
+	workDone.wait(guard, [this] { return !busy && pending.empty(); });
+
+	if (history.empty())
+		return false;
+
+	for (size_t i = 0; i < steps && history.size() > 1; i++)
+	{
+		historyBytes -= history.back().data.size();
+		history.pop_back();
+	}
+	frameCounter = 0;
+
+	const Snapshot& snapshot = history.back();
+	if (snapshot.keyframe)
+		return bus.loadState(snapshot.data);
+
+	const std::vector<uint8_t>& base = history[keyframeOf(history.size() - 1)].data;
+	decodeDelta(base.data(), base.size(), snapshot.data, decoded);
+	return bus.loadState(decoded);
+}
+
+void RewindBuffer::clear()
+{
+	std::unique_lock<std::mutex> guard(lock);
+	workDone.wait(guard, [this] { return !busy && pending.empty(); });
+	history.clear();
+	historyBytes = 0;
+	frameCounter = 0;
+}
+
+size_t RewindBuffer::snapshotCount()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return history.size() + pending.size() + (busy ? 1 : 0);
+}
+
+size_t RewindBuffer::memoryUsed()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return historyBytes;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class Bus;
+
+//Ring of past machine states for rewinding.
+//push() only takes a raw save state (a few hundred ns) and queues it, a background thread turns it
+//into either a keyframe (stored as is) or an XOR/RLE delta against the newest keyframe.
+//Restoring decodes one delta against one keyframe, so any snapshot comes back in a few microseconds.
+//When the history outgrows the memory cap the oldest keyframe and its deltas are dropped together.
+class RewindBuffer
+{
+private:
+	struct Snapshot
+	{
+		bool keyframe;
+		std::vector<uint8_t> data;
+	};
+
+	size_t memoryCap;
+	unsigned snapshotInterval;
+	unsigned keyframeInterval;
+	unsigned frameCounter = 0;
+
+	std::mutex lock;
+	std::condition_variable workAdded;
+	std::condition_variable workDone;
+	std::deque<std::vector<uint8_t>> pending;
+	std::vector<std::vector<uint8_t>> spare;
+	bool busy = false;
+	bool stopping = false;
+
+	//changed under the lock, the worker reads it unlocked while busy since nobody else changes it then
+	std::deque<Snapshot> history;
+	size_t historyBytes = 0;
+	std::vector<uint8_t> decoded;
+
+	std::thread worker;
+
+	void workerLoop();
+	//keyframes take over the raw buffer, deltas leave it to be reused
+	Snapshot encode(std::vector<uint8_t>& raw) const;
+	void trim();
+	//index of the keyframe a snapshot was encoded against
+	size_t keyframeOf(size_t index) const;
+
+public:
+	//snapshotInterval: frames between snapshots, keyframeInterval: snapshots between keyframes
+	RewindBuffer(size_t memoryCap = 64 * 1024 * 1024, unsigned snapshotInterval = 1, unsigned keyframeInterval = 60);
+	~RewindBuffer();
+
+	RewindBuffer(const RewindBuffer&) = delete;
+	RewindBuffer& operator=(const RewindBuffer&) = delete;
+
+	//call once per emulated frame, every snapshotInterval-th call records the machine
+	void push(const Bus& bus);
+	//drops the newest snapshots and loads the one steps back, the loaded one stays in the history.
+	//With a single snapshot left it is loaded again. false if there is nothing to load.
+	bool rewind(Bus& bus, size_t steps = 1);
+	void clear();
+
+	size_t snapshotCount();
+	size_t memoryUsed();
+};
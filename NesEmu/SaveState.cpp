@@ -0,0 +1,107 @@
+#include "SaveState.h"
+
+namespace
+{
+	struct FileHeader
+	{
+		char magic[4];
+		uint32_t version;
+	};
+
+	struct ChunkHeader
+	{
+		char tag[4];
+		uint32_t version;
+		uint32_t size;
+	};
+}
+
+StateWriter::StateWriter(std::vector<uint8_t>& out)
+	: out(out)
+{
+	FileHeader header = { {'N', 'E', 'S', 'S'}, SAVE_STATE_VERSION };
+	out.clear();
+	out.resize(sizeof(FileHeader));
+	std::memcpy(out.data(), &header, sizeof(FileHeader));
+}
+
+void StateWriter::writeChunk(const char tag[4], uint32_t version, const void* data, uint32_t size)
+{
+	std::memcpy(reserveChunk(tag, version, size), data, size);
+}
+
+uint8_t* StateWriter::reserveChunk(const char tag[4], uint32_t version, uint32_t size)
+{
+	ChunkHeader header;
+	std::memcpy(header.tag, tag, 4);
+	header.version = version;
+	header.size = size;
+
+	size_t pos = out.size();
+	out.resize(pos + sizeof(ChunkHeader) + size);
+	std::memcpy(out.data() + pos, &header, sizeof(ChunkHeader));
+	return out.data() + pos + sizeof(ChunkHeader);
+}
+
+StateReader::StateReader(const uint8_t* data, size_t size)
+	: data(data), size(size)
+{
+	FileHeader header;
+	if (data == nullptr || size < sizeof(FileHeader))
+		return;
+
+	std::memcpy(&header, data, sizeof(FileHeader));
+	m_valid = std::memcmp(header.magic, "NESS", 4) == 0 && header.version == SAVE_STATE_VERSION;
+}
+
+const uint8_t* StateReader::findChunk(const char tag[4], uint32_t& version, uint32_t& size) const
+{
+	size_t pos = sizeof(FileHeader);
+	while (pos + sizeof(ChunkHeader) <= this->size)
+	{
+		ChunkHeader header;
+		std::memcpy(&header, data + pos, sizeof(ChunkHeader));
+		pos += sizeof(ChunkHeader);
+
+		if (header.size > this->size - pos)
+			return nullptr;
+
+		if (std::memcmp(header.tag, tag, 4) == 0)
+		{
+			version = header.version;
+			size = header.size;
+			return data + pos;
+		}
+
+		pos += header.size;
+	}
+	return nullptr;
+}
+
+bool StateReader::contains(const char tag[4]) const
+{
+	uint32_t version = 0, size = 0;
+	return m_valid && findChunk(tag, version, size) != nullptr;
+}
+
+const uint8_t* StateReader::chunkData(const char tag[4], uint32_t version, uint32_t size) const
+{
+	if (!m_valid)
+		return nullptr;
+
+	uint32_t chunkVersion = 0, chunkSize = 0;
+	const uint8_t* chunk = findChunk(tag, chunkVersion, chunkSize);
+	if (chunk == nullptr || chunkVersion != version || chunkSize != size)
+		return nullptr;
+	return chunk;
+}
+
+bool StateReader::readChunk(const char tag[4], uint32_t version, void* block, uint32_t size) const
+{
+	const uint8_t* chunk = chunkData(tag, version, size);
+	if (chunk == nullptr)
+		return false;
+
+	std::memcpy(block, chunk, size);
+	return true;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cinttypes>
+#include <cstring>
+#include <vector>
+#include <type_traits>
+
+//Save state layout, everything in host byte order:
+//	header: "NESS", uint32 format version
+//	chunks: char tag[4], uint32 chunk version, uint32 size, size bytes
+//Every chunk body is a plain struct or raw memory block, so saving and loading is a memcpy per chunk.
+//Readers skip chunks they don't know and reject chunks whose version or size don't match.
+
+constexpr uint32_t SAVE_STATE_VERSION = 1;
+
+class StateWriter
+{
+private:
+	std::vector<uint8_t>& out;
+
+public:
+	//clears out but keeps its capacity, so a reused buffer doesn't allocate
+	StateWriter(std::vector<uint8_t>& out);
+
+	void writeChunk(const char tag[4], uint32_t version, const void* data, uint32_t size);
+	//for blocks that aren't contiguous in memory, the caller fills the returned bytes
+	uint8_t* reserveChunk(const char tag[4], uint32_t version, uint32_t size);
+
+	template <typename T>
+	void write(const char tag[4], uint32_t version, const T& block)
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "state blocks must be memcpy-able");
+		writeChunk(tag, version, &block, sizeof(T));
+	}
+};
+
+class StateReader
+{
+private:
+	const uint8_t* data;
+	size_t size;
+	bool m_valid = false;
+
+	const uint8_t* findChunk(const char tag[4], uint32_t& version, uint32_t& size) const;
+
+public:
+	StateReader(const uint8_t* data, size_t size);
+
+	bool readChunk(const char tag[4], uint32_t version, void* block, uint32_t size) const;
+	bool contains(const char tag[4]) const;
+	//body of a chunk with this exact version and size, nullptr otherwise
+	const uint8_t* chunkData(const char tag[4], uint32_t version, uint32_t size) const;
+
+	template <typename T>
+	bool read(const char tag[4], uint32_t version, T& block) const
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "state blocks must be memcpy-able");
+		return readChunk(tag, version, &block, sizeof(T));
+	}
+
+	bool valid() const { return m_valid; }
+};
@@ -0,0 +1,269 @@
+#include "ScanlineRenderer.h"
+#include "ThreadPool.h"
+#include "nes2c02.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+	//PPUCTRL and PPUMASK bits the background uses
+	constexpr uint8_t CONTROL_BG_PATTERN = 0x10;
+	constexpr uint8_t MASK_GREYSCALE = 0x01;
+	constexpr uint8_t MASK_BG_SHOW = 0x08;
+	constexpr uint8_t MASK_SPRITE_SHOW = 0x10;
+
+	//one band's copy of the ppu memory, moved along the log as the band's lines are rendered
+	struct Memory
+	{
+		const uint8_t* pattern;
+		uint8_t patternCopy[0x2000];
+		bool patternWritten = false;
+		uint8_t nameTable[2][1024];
+		uint8_t palette[32];
+		bool vertical;
+
+		uint8_t* nameTableByte(uint16_t addr)
+		{
+			addr &= 0x0FFF;
+			return &nameTable[vertical ? (addr >> 10) & 1 : (addr >> 11) & 1][addr & 0x03FF];
+		}
+
+		static uint16_t paletteIndex(uint16_t addr)
+		{
+			addr &= 0x001F;
+			return (addr & 0x0013) == 0x0010 ? addr & 0x000F : addr;
+		}
+
+		uint8_t read(uint16_t addr, uint8_t mask)
+		{
+			addr &= 0x3FFF;
+			if (addr < 0x2000)
+				return pattern[addr];
+			if (addr < 0x3F00)
+				return *nameTableByte(addr);
+			return palette[paletteIndex(addr)] & ((mask & MASK_GREYSCALE) ? 0x30 : 0x3F);
+		}
+
+		//the ppu logs the byte it holds after the write, so chr rom writes arrive as no change
+		void write(uint16_t addr, uint8_t data)
+		{
+			addr &= 0x3FFF;
+			if (addr < 0x2000)
+			{
+				//the frame's pattern snapshot is shared by the bands until one of them has to change it
+				if (!patternWritten)
+				{
+					std::memcpy(patternCopy, pattern, sizeof(patternCopy));
+					pattern = patternCopy;
+					patternWritten = true;
+				}
+				patternCopy[addr] = data;
+			}
+			else if (addr < 0x3F00)
+				*nameTableByte(addr) = data;
+			else
+				palette[paletteIndex(addr)] = data;
+		}
+	};
+
+	//what the dot renderer keeps between dots for the background
+	struct Pipeline
+	{
+		uint8_t nextId, nextAttrib, nextLow, nextHigh;
+		uint16_t patternLow, patternHigh, attribLow, attribHigh;
+	};
+}
+
+ScanlineRenderer::ScanlineRenderer(ThreadPool* pool)
+	:pool(pool)
+{
+	for (int i = 0; i < 2; i++)
+		frames[i].pixels.assign(nes2c02::SCREEN_WIDTH * nes2c02::SCREEN_HEIGHT, 0);
+}
+
+ScanlineRenderer::~ScanlineRenderer()
+{
+	//the bands point into this object
+	wait(0);
+	wait(1);
+}
+
+void ScanlineRenderer::wait(int index)
+{
+	std::unique_lock<std::mutex> guard(lock);
+	done.wait(guard, [&] { return remaining[index] == 0; });
+}
+
+ScanlineRenderer::Frame& ScanlineRenderer::begin()
+{
+	//the slot that is not the newest frame, the one before it may still be rendering
+	current = latest == 0 ? 1 : 0;
+	wait(current);
+	frames[current].events.clear();
+	return frames[current];
+}
+
+void ScanlineRenderer::logRegisters(int32_t position, const Registers& registers)
+{
+	frames[current].events.push_back({ position, false, registers, 0, 0 });
+}
+
+void ScanlineRenderer::logMemory(int32_t position, uint16_t addr, uint8_t data)
+{
+	frames[current].events.push_back({ position, true, {}, addr, data });
+}
+
+void ScanlineRenderer::submit()
+{
+	if (current < 0)
+		return;
+
+	int index = current;
+	current = -1;
+	latest = index;
+
+	int bands = (nes2c02::SCREEN_HEIGHT + BAND_LINES - 1) / BAND_LINES;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		remaining[index] = bands;
+	}
+	for (int first = 0; first < nes2c02::SCREEN_HEIGHT; first += BAND_LINES)
+	{
+		int last = std::min(first + BAND_LINES, nes2c02::SCREEN_HEIGHT);
+		if (pool != nullptr)
+			pool->submit([this, index, first, last] { renderBand(index, first, last); });
+		else
+			renderBand(index, first, last);
+	}
+}
+
+const uint8_t* ScanlineRenderer::frameBuffer()
+{
+	if (latest < 0)
+		return nullptr;
+	wait(latest);
+	return frames[latest].pixels.data();
+}
+
+void ScanlineRenderer::renderBand(int index, int first, int last)
+{
+	const Frame& frame = frames[index];
+	uint8_t* pixels = frames[index].pixels.data();
+	const std::vector<Event>& events = frame.events;
+	size_t next = 0;
+
+	Memory memory;
+	memory.pattern = frame.pattern;
+	std::memcpy(memory.nameTable, frame.nameTable, sizeof(memory.nameTable));
+	std::memcpy(memory.palette, frame.palette, sizeof(memory.palette));
+	memory.vertical = frame.vertical;
+
+	for (int line = first; line < last; line++)
+	{
+		//a line is fetched from dot 321 of the line before, the registers there are in lineStart,
+		//memory has to catch up with every write before it
+		int32_t start = position(line - 1, 321);
+		int32_t end = position(line, 257);
+		for (; next < events.size() && events[next].position < start; next++)
+		{
+			if (events[next].memory)
+				memory.write(events[next].addr, events[next].data);
+		}
+
+		Registers r = frame.lineStart[line];
+		//the prefetch shifts out whatever the pipeline held, so a line can start from an empty one
+		Pipeline p = {};
+		uint8_t* out = pixels + line * nes2c02::SCREEN_WIDTH;
+
+		int scanline = line - 1;
+		int cycle = 321;
+		for (int32_t dot = start; dot < end; dot++)
+		{
+			for (; next < events.size() && events[next].position <= dot; next++)
+			{
+				if (events[next].memory)
+					memory.write(events[next].addr, events[next].data);
+				else
+					r = events[next].registers;
+			}
+
+			//the background half of nes2c02::clock(), see there
+			bool rendering = (r.mask & (MASK_BG_SHOW | MASK_SPRITE_SHOW)) != 0;
+			if ((cycle >= 2 && cycle < 258) || (cycle >= 321 && cycle < 338))
+			{
+				if (r.mask & MASK_BG_SHOW)
+				{
+					p.patternLow <<= 1;
+					p.patternHigh <<= 1;
+					p.attribLow <<= 1;
+					p.attribHigh <<= 1;
+				}
+
+				switch ((cycle - 1) % 8)
+				{
+				case 0:
+					p.patternLow = (p.patternLow & 0xFF00) | p.nextLow;
+					p.patternHigh = (p.patternHigh & 0xFF00) | p.nextHigh;
+					p.attribLow = (p.attribLow & 0xFF00) | ((p.nextAttrib & 0b01) ? 0xFF : 0x00);
+					p.attribHigh = (p.attribHigh & 0xFF00) | ((p.nextAttrib & 0b10) ? 0xFF : 0x00);
+					p.nextId = memory.read(0x2000 | (r.v & 0x0FFF), r.mask);
+					break;
+				case 2:
+				{
+					uint16_t coarseX = r.v & 0x001F;
+					uint16_t coarseY = (r.v >> 5) & 0x001F;
+					p.nextAttrib = memory.read(0x23C0 | (r.v & 0x0C00) | ((coarseY >> 2) << 3) | (coarseX >> 2), r.mask);
+					if (coarseY & 0x02) p.nextAttrib >>= 4;
+					if (coarseX & 0x02) p.nextAttrib >>= 2;
+					p.nextAttrib &= 0x03;
+					break;
+				}
+				case 4:
+					p.nextLow = memory.read(((r.control & CONTROL_BG_PATTERN) << 8) + ((uint16_t)p.nextId << 4) + ((r.v >> 12) & 0x07), r.mask);
+					break;
+				case 6:
+					p.nextHigh = memory.read(((r.control & CONTROL_BG_PATTERN) << 8) + ((uint16_t)p.nextId << 4) + ((r.v >> 12) & 0x07) + 8, r.mask);
+					break;
+				case 7:
+					if (rendering)
+					{
+						if ((r.v & 0x001F) == 31)
+							r.v = (r.v & ~0x001F) ^ 0x0400;
+						else
+							r.v++;
+					}
+					break;
+				}
+			}
+
+			//the line's first fetch is at dot 9, the id it uses comes from here
+			if (cycle == 338 || cycle == 340)
+				p.nextId = memory.read(0x2000 | (r.v & 0x0FFF), r.mask);
+
+			if (scanline == line && cycle >= 1)
+			{
+				uint8_t pixel = 0x00;
+				uint8_t palette = 0x00;
+				if (r.mask & MASK_BG_SHOW)
+				{
+					uint16_t bit = 0x8000 >> r.fineX;
+					pixel = (((p.patternHigh & bit) > 0) << 1) | ((p.patternLow & bit) > 0);
+					palette = (((p.attribHigh & bit) > 0) << 1) | ((p.attribLow & bit) > 0);
+				}
+				out[cycle - 1] = memory.read(0x3F00 + (palette << 2) + pixel, r.mask) & 0x3F;
+			}
+
+			if (++cycle == 341)
+			{
+				cycle = 0;
+				scanline++;
+			}
+		}
+	}
+
+	//counted down under the lock, a waiter that sees zero may destroy this as soon as it gets it
+	std::lock_guard<std::mutex> guard(lock);
+	if (--remaining[index] == 0)
+		done.notify_all();
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cinttypes>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+class ThreadPool;
+
+//Deferred background renderer for nes2c02.
+//While a frame is drawn the ppu only keeps its timing and logs into a Frame: the memory it starts
+//the frame with, the scroll registers at the dot each visible line starts fetching (dot 321 of the
+//line before) and every register or memory change with the dot it happened on. When the visible
+//lines are done the frame is cut into bands of lines that are rendered on the pool, each band
+//replaying the fetches of the dot renderer from the log, so the pixels are the same. The cpu goes on
+//into vblank meanwhile, the pixels are only waited for when frameBuffer() is asked for them.
+class ScanlineRenderer
+{
+public:
+	//the registers the background fetches depend on
+	struct Registers
+	{
+		uint16_t v, t;
+		uint8_t fineX, control, mask;
+	};
+
+	//a register snapshot after a write, or a memory write through $2007
+	struct Event
+	{
+		int32_t position;
+		bool memory;
+		Registers registers;
+		uint16_t addr;
+		uint8_t data;
+	};
+
+	struct Frame
+	{
+		//ppu memory at the start of the pre-render line, $0000-$1FFF as the cartridge maps it then
+		uint8_t pattern[0x2000];
+		uint8_t nameTable[2][1024];
+		uint8_t palette[32];
+		bool vertical;
+		Registers lineStart[240];
+		std::vector<Event> events;
+		std::vector<uint8_t> pixels;
+	};
+
+	//dot index within a frame, the pre-render line is 0
+	static int32_t position(int scanline, int cycle) { return (scanline + 1) * 341 + cycle; }
+
+private:
+	//lines per pool job
+	static constexpr int BAND_LINES = 16;
+
+	ThreadPool* pool;
+	//logged into and in flight, one frame can be rendered while the next is logged
+	Frame frames[2];
+	//bands still rendering per frame, only touched under lock
+	int remaining[2] = {};
+	std::mutex lock;
+	std::condition_variable done;
+	int current = -1;
+	int latest = -1;
+
+	void wait(int index);
+	void renderBand(int index, int first, int last);
+
+public:
+	//without a pool the bands are rendered on the calling thread when the frame is submitted
+	ScanlineRenderer(ThreadPool* pool);
+	~ScanlineRenderer();
+
+	ScanlineRenderer(const ScanlineRenderer&) = delete;
+	ScanlineRenderer& operator=(const ScanlineRenderer&) = delete;
+
+	//the frame to log into, the caller fills in its memory and line starts
+	Frame& begin();
+	bool logging() const { return current >= 0; }
+	Frame& frame() { return frames[current]; }
+	void logRegisters(int32_t position, const Registers& registers);
+	void logMemory(int32_t position, uint16_t addr, uint8_t data);
+	//starts rendering the logged frame
+	void submit();
+	//drops the frame being logged, after a state load its log no longer fits the machine
+	void abort() { current = -1; }
+
+	//palette indices of the newest submitted frame, nullptr before the first one
+	const uint8_t* frameBuffer();
+};
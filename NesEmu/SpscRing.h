@@ -0,0 +1,70 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+//Lock-free ring for exactly one producer thread and one consumer thread.
+//Both sides only ever advance their own index, the other index is read with acquire so the items
+//behind it are visible. Indices count up without wrapping and are masked on access, so full and
+//empty don't need a spare slot.
+template <typename T>
+class SpscRing
+{
+private:
+	std::unique_ptr<T[]> items;
+	size_t mask;
+
+	//on separate cache lines so the two threads don't invalidate each other's index on every access
+	alignas(64) std::atomic<size_t> readIndex{ 0 };
+	alignas(64) std::atomic<size_t> writeIndex{ 0 };
+
+public:
+	//capacity is rounded up to a power of two
+	explicit SpscRing(size_t capacity)
+	{
+		size_t size = 1;
+		while (size < capacity)
+			size <<= 1;
+		items = std::make_unique<T[]>(size);
+		mask = size - 1;
+	}
+
+	size_t capacity() const { return mask + 1; }
+	//exact from either side for its own purposes: never more than is there for the consumer,
+	//never less than is there for the producer
+	size_t size() const { return writeIndex.load(std::memory_order_acquire) - readIndex.load(std::memory_order_acquire); }
+
+	//producer only, returns how many fit
+	size_t push(const T* data, size_t count)
+	{
+		size_t write = writeIndex.load(std::memory_order_relaxed);
+		size_t read = readIndex.load(std::memory_order_acquire);
+		count = std::min(count, capacity() - (write - read));
+
+		size_t start = write & mask;
+		size_t first = std::min(count, capacity() - start);
+		std::copy(data, data + first, items.get() + start);
+		std::copy(data + first, data + count, items.get());
+
+		writeIndex.store(write + count, std::memory_order_release);
+		return count;
+	}
+
+	//consumer only, returns how many were there
+	size_t pop(T* out, size_t count)
+	{
+		size_t read = readIndex.load(std::memory_order_relaxed);
+		size_t write = writeIndex.load(std::memory_order_acquire);
+		count = std::min(count, write - read);
+
+		size_t start = read & mask;
+		size_t first = std::min(count, capacity() - start);
+		std::copy(items.get() + start, items.get() + start + first, out);
+		std::copy(items.get(), items.get() + (count - first), out + first);
+
+		readIndex.store(read + count, std::memory_order_release);
+		return count;
+	}
+};
@@ -0,0 +1,111 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+namespace
+{
+	//which pool and deque the current thread works for, so jobs can submit into their own deque
+	thread_local const ThreadPool* currentPool = nullptr;
+	thread_local size_t currentWorker = 0;
+}
+
+ThreadPool::ThreadPool(size_t threadCount)
+{
+	if (threadCount == 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+	for (size_t i = 0; i < threadCount; i++)
+		queues.push_back(std::make_unique<Queue>());
+	for (size_t i = 0; i < threadCount; i++)
+		workers.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> guard(sleepLock);
+		stopping = true;
+	}
+	jobAdded.notify_all();
+	for (auto& worker : workers)
+		worker.join();
+}
+
+void ThreadPool::submit(std::function<void()> job)
+{
+	//counted before it is visible, a worker may finish it before push_back returns here
+	pending++;
+	queued++;
+
+	size_t index = currentPool == this ? currentWorker : nextQueue++ % queues.size();
+	{
+		std::lock_guard<std::mutex> guard(queues[index]->lock);
+		queues[index]->jobs.push_back(std::move(job));
+	}
+
+	//taking the lock orders this with a worker that just found nothing and is about to sleep
+	{
+		std::lock_guard<std::mutex> guard(sleepLock);
+	}
+	jobAdded.notify_one();
+}
+
+void ThreadPool::wait()
+{
+	std::unique_lock<std::mutex> guard(sleepLock);
+	jobsDone.wait(guard, [this] { return pending == 0; });
+}
+
+bool ThreadPool::takeJob(size_t worker, std::function<void()>& job)
+{
+	{
+		Queue& own = *queues[worker];
+		std::lock_guard<std::mutex> guard(own.lock);
+		if (!own.jobs.empty())
+		{
+			job = std::move(own.jobs.back());
+			own.jobs.pop_back();
+			return true;
+		}
+	}
+
+	for (size_t i = 1; i < queues.size(); i++)
+	{
+		Queue& victim = *queues[(worker + i) % queues.size()];
+		std::lock_guard<std::mutex> guard(victim.lock);
+		if (!victim.jobs.empty())
+		{
+			job = std::move(victim.jobs.front());
+			victim.jobs.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+void ThreadPool::workerLoop(size_t worker)
+{
+	currentPool = this;
+	currentWorker = worker;
+
+	while (true)
+	{
+		std::function<void()> job;
+		if (takeJob(worker, job))
+		{
+			queued--;
+			job();
+			if (--pending == 0)
+			{
+				std::lock_guard<std::mutex> guard(sleepLock);
+				jobsDone.notify_all();
+			}
+			continue;
+		}
+
+		std::unique_lock<std::mutex> guard(sleepLock);
+		jobAdded.wait(guard, [this] { return stopping || queued != 0; });
+		if (stopping && queued == 0)
+			return;
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//Work-stealing thread pool.
+//Every worker owns a deque, it takes its own jobs from the back and steals from the front of the
+//others when it runs dry, so long and short jobs even out without one shared queue to fight over.
+//Jobs submitted from outside are dealt round robin, jobs submitted by a worker go to its own deque.
+class ThreadPool
+{
+private:
+	struct Queue
+	{
+		std::mutex lock;
+		std::deque<std::function<void()>> jobs;
+	};
+
+	std::vector<std::unique_ptr<Queue>> queues;
+	std::vector<std::thread> workers;
+
+	//idle workers and wait() sleep on this, the counters are only changed outside of it
+	std::mutex sleepLock;
+	std::condition_variable jobAdded;
+	std::condition_variable jobsDone;
+	std::atomic<size_t> queued{ 0 };
+	std::atomic<size_t> pending{ 0 };
+	std::atomic<size_t> nextQueue{ 0 };
+	bool stopping = false;
+
+	bool takeJob(size_t worker, std::function<void()>& job);
+	void workerLoop(size_t worker);
+
+public:
+	//0 uses one thread per hardware thread
+	ThreadPool(size_t threadCount = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	void submit(std::function<void()> job);
+	//blocks until every submitted job has finished, must not be called from a job
+	void wait();
+
+	size_t size() const { return workers.size(); }
+};
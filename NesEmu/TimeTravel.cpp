@@ -0,0 +1,234 @@
+#include "TimeTravel.h"
+#include "Bus.h"
+
+TimeTravel::TimeTravel(Bus& bus, size_t maxCheckpoints)
+	: bus(bus), maxCheckpoints(maxCheckpoints ? maxCheckpoints : 1)
+{}
+
+void TimeTravel::sync()
+{
+	size_t position = bus.getClockCounter();
+	if (position < recordedUntil)
+		truncate(position);
+	recordedUntil = position;
+
+	if (inputs.empty() || inputs.back().controller[0] != bus.controller[0] || inputs.back().controller[1] != bus.controller[1])
+		inputs.push_back({ position, { bus.controller[0], bus.controller[1] } });
+}
+
+void TimeTravel::truncate(size_t position)
+{
+	while (!checkpoints.empty() && checkpoints.back().position > position)
+		checkpoints.pop_back();
+	while (!inputs.empty() && inputs.back().position > position)
+		inputs.pop_back();
+
+	nextCheckpoint = checkpoints.empty() ? 0 : checkpoints.back().position + CHECKPOINT_DOTS;
+	recordedUntil = position;
+}
+
+void TimeTravel::takeCheckpoint()
+{
+	Checkpoint checkpoint;
+	checkpoint.position = bus.getClockCounter();
+	if (checkpoints.size() >= maxCheckpoints)
+	{
+		//reuse the oldest buffer, and drop the inputs only it needed
+		checkpoint.state = std::move(checkpoints.front().state);
+		checkpoints.pop_front();
+		while (!checkpoints.empty() && inputs.size() > 1 && inputs[1].position <= checkpoints.front().position)
+			inputs.pop_front();
+	}
+
+	bus.saveState(checkpoint.state);
+	checkpoints.push_back(std::move(checkpoint));
+	nextCheckpoint = bus.getClockCounter() + CHECKPOINT_DOTS;
+}
+
+void TimeTravel::clock()
+{
+	sync();
+	tick();
+}
+
+void TimeTravel::tick()
+{
+	//checkpoints sit on instruction boundaries so a replay never starts halfway through one
+	if (bus.atInstructionBoundary() && bus.getClockCounter() >= nextCheckpoint)
+		takeCheckpoint();
+	bus.clock();
+	recordedUntil = bus.getClockCounter();
+}
+
+void TimeTravel::step()
+{
+	sync();
+	bool starting;
+	do
+	{
+		starting = bus.atInstructionBoundary();
+		tick();
+	} while (!starting);
+}
+
+void TimeTravel::runFrame()
+{
+	sync();
+	bus.beginFrame();
+	while (!bus.frameComplete())
+		tick();
+}
+
+int TimeTravel::checkpointBefore(size_t position) const
+{
+	for (int i = (int)checkpoints.size() - 1; i >= 0; i--)
+	{
+		if (checkpoints[i].position < position)
+			return i;
+	}
+	return -1;
+}
+
+size_t TimeTravel::searchSegment(int segment, size_t end, size_t limit, Query query, uint16_t address, uint16_t& pc)
+{
+	bus.loadState(checkpoints[segment].state);
+	if (query == Query::Write)
+	{
+		bus.writeWatch = address <= 0x1FFF ? address & 0x07FF : address;
+		bus.watchHit = false;
+	}
+
+	size_t found = 0;
+	size_t inputIndex = 0;
+	uint16_t instructionPc = bus.cpu.pc;
+	while (bus.getClockCounter() < end)
+	{
+		size_t position = bus.getClockCounter();
+		while (inputIndex < inputs.size() && inputs[inputIndex].position <= position)
+		{
+			bus.controller[0] = inputs[inputIndex].controller[0];
+			bus.controller[1] = inputs[inputIndex].controller[1];
+			inputIndex++;
+		}
+
+		bool starting = bus.atInstructionBoundary();
+		if (starting)
+			instructionPc = bus.cpu.pc;
+		bus.clock();
+
+		size_t stop = bus.getClockCounter();
+		if (stop >= limit)
+			continue;
+
+		bool match = false;
+		switch (query)
+		{
+		case Query::Step:
+			match = starting;
+			break;
+		case Query::Breakpoint:
+			match = starting && breakpoints.count(bus.cpu.pc) != 0;
+			break;
+		case Query::Write:
+			match = bus.watchHit;
+			bus.watchHit = false;
+			break;
+		}
+
+		if (match)
+		{
+			found = stop;
+			pc = instructionPc;
+		}
+	}
+
+	bus.writeWatch = -1;
+	return found;
+}
+
+size_t TimeTravel::findLast(Query query, uint16_t address, uint16_t& pc)
+{
+	size_t current = bus.getClockCounter();
+	int segment = checkpointBefore(current);
+	for (; segment >= 0; segment--)
+	{
+		size_t end = segment + 1 < (int)checkpoints.size() ? checkpoints[segment + 1].position : current;
+		size_t found = searchSegment(segment, end, current, query, address, pc);
+		if (found != 0)
+			return found;
+	}
+	return 0;
+}
+
+void TimeTravel::goTo(size_t position)
+{
+	//a limit of 0 matches nothing, this is only the replay
+	uint16_t pc = 0;
+	searchSegment(checkpointBefore(position), position, 0, Query::Step, 0, pc);
+}
+
+bool TimeTravel::reverseStep()
+{
+	sync();
+	std::vector<uint8_t> present;
+	bus.saveState(present);
+
+	uint16_t pc = 0;
+	size_t target = findLast(Query::Step, 0, pc);
+	if (target == 0)
+	{
+		bus.loadState(present);
+		return false;
+	}
+	goTo(target);
+	return true;
+}
+
+bool TimeTravel::reverseContinue()
+{
+	sync();
+	std::vector<uint8_t> present;
+	bus.saveState(present);
+
+	uint16_t pc = 0;
+	size_t target = breakpoints.empty() ? 0 : findLast(Query::Breakpoint, 0, pc);
+	if (target == 0)
+	{
+		bus.loadState(present);
+		return false;
+	}
+	goTo(target);
+	return true;
+}
+
+TimeTravel::WriteRecord TimeTravel::lastWrite(uint16_t address)
+{
+	sync();
+	std::vector<uint8_t> present;
+	bus.saveState(present);
+
+	uint8_t pads[2] = { bus.controller[0], bus.controller[1] };
+
+	WriteRecord record;
+	record.position = findLast(Query::Write, address, record.pc);
+	record.found = record.position != 0;
+
+	bus.loadState(present);
+	bus.controller[0] = pads[0];
+	bus.controller[1] = pads[1];
+	return record;
+}
+
+void TimeTravel::toggleBreakpoint(uint16_t address)
+{
+	if (!breakpoints.erase(address))
+		breakpoints.insert(address);
+}
+
+void TimeTravel::clear()
+{
+	checkpoints.clear();
+	inputs.clear();
+	nextCheckpoint = 0;
+	recordedUntil = 0;
+}
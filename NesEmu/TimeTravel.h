@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cinttypes>
+#include <cstddef>
+#include <deque>
+#include <set>
+#include <vector>
+
+class Bus;
+
+//Reverse execution for the debugger.
+//While running forward it keeps a save state every CHECKPOINT_DOTS ppu dots and a log of pad changes.
+//Going backwards loads the nearest checkpoint and replays from it with the logged inputs, so a
+//reverse step costs at most two replays of one checkpoint interval.
+//Stop points are the states right after an instruction executed, the same ones step() stops at.
+class TimeTravel
+{
+public:
+	//4 frames between checkpoints, a reverse step replays at most 8 frames (~15 ms release, ~40 ms debug)
+	static constexpr size_t CHECKPOINT_DOTS = 341 * 262 * 4;
+
+	struct WriteRecord
+	{
+		bool found = false;
+		size_t position = 0;
+		uint16_t pc = 0;
+	};
+
+private:
+	struct Checkpoint
+	{
+		size_t position;
+		std::vector<uint8_t> state;
+	};
+
+	struct InputEvent
+	{
+		size_t position;
+		uint8_t controller[2];
+	};
+
+	enum class Query
+	{
+		Step,
+		Breakpoint,
+		Write
+	};
+
+	Bus& bus;
+	size_t maxCheckpoints;
+	std::deque<Checkpoint> checkpoints;
+	std::deque<InputEvent> inputs;
+	size_t nextCheckpoint = 0;
+	//newest position recorded, seeing the bus behind it means a state was loaded or the bus was reset
+	size_t recordedUntil = 0;
+	std::set<uint16_t> breakpoints;
+
+	void sync();
+	void truncate(size_t position);
+	void takeCheckpoint();
+	void tick();
+	//last checkpoint strictly before position, -1 if there is none
+	int checkpointBefore(size_t position) const;
+	//replays segment from its checkpoint until end, returns the last matching stop point before limit or 0
+	size_t searchSegment(int segment, size_t end, size_t limit, Query query, uint16_t address, uint16_t& pc);
+	size_t findLast(Query query, uint16_t address, uint16_t& pc);
+	void goTo(size_t position);
+
+public:
+	TimeTravel(Bus& bus, size_t maxCheckpoints = 2048);
+
+	//forward execution, everything the debugger runs has to go through these to be recorded
+	void clock();
+	void step();
+	void runFrame();
+
+	//back to the previous stop point
+	bool reverseStep();
+	//back to the newest stop point where pc is on a breakpoint
+	bool reverseContinue();
+	//newest write to address before the current position, the machine stays where it is
+	WriteRecord lastWrite(uint16_t address);
+
+	void toggleBreakpoint(uint16_t address);
+	bool isBreakpoint(uint16_t address) const { return breakpoints.count(address) != 0; }
+
+	void clear();
+};
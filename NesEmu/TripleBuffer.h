@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+//Lock-free hand-over of the newest value from one writer thread to one reader thread.
+//The writer fills its back slot and publish() swaps it with the middle one, the reader swaps the
+//middle slot with its front one when something new was published. Neither side ever waits, the
+//writer just overwrites values the reader was too slow to pick up.
+template <typename T>
+class TripleBuffer
+{
+private:
+	static constexpr uint8_t INDEX = 0x03;
+	//set in middle by publish(), cleared when the reader takes it
+	static constexpr uint8_t FRESH = 0x04;
+
+	T slots[3];
+	std::atomic<uint8_t> middle{ 1 };
+	uint8_t back = 0;
+	uint8_t front = 2;
+
+public:
+	TripleBuffer() = default;
+	explicit TripleBuffer(const T& value) : slots{ value, value, value } {}
+
+	//writer
+	T& writeBuffer() { return slots[back]; }
+	void publish()
+	{
+		back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX;
+	}
+
+	//reader, true if a value was published since the last call and readBuffer() changed to it
+	bool update()
+	{
+		if (!(middle.load(std::memory_order_relaxed) & FRESH))
+			return false;
+		front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+		return true;
+	}
+	const T& readBuffer() const { return slots[front]; }
+};
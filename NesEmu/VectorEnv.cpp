@@ -0,0 +1,122 @@
+#include "VectorEnv.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <array>
+
+namespace
+{
+	//Rec. 601 luma of every palette entry
+	std::array<uint8_t, 0x40> makeLuminance()
+	{
+		std::array<uint8_t, 0x40> luminance = {};
+		for (int i = 0; i < 0x40; i++)
+		{
+			const uint8_t* c = nes2c02::ppuPalette[i];
+			luminance[i] = (uint8_t)((299 * c[0] + 587 * c[1] + 114 * c[2]) / 1000);
+		}
+		return luminance;
+	}
+
+	const std::array<uint8_t, 0x40> luminance = makeLuminance();
+}
+
+VectorEnv::VectorEnv(std::shared_ptr<Cartridge> cartridge, size_t count, ThreadPool& pool, ObservationOptions options)
+	: pool(pool), options(options)
+{
+	if (this->options.downsample != 2 && this->options.downsample != 4)
+		this->options.downsample = 1;
+
+	machines.reserve(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		machines.push_back(std::make_unique<Bus>());
+		machines.back()->insertCartridge(cartridge->fork());
+		machines.back()->reset();
+		machines.back()->apu.setOutput(false);
+	}
+	observationBuffer.resize(count * observationWidth() * observationHeight());
+}
+
+void VectorEnv::captureSnapshot(size_t env)
+{
+	machines[env]->saveState(snapshot);
+}
+
+bool VectorEnv::setSnapshot(const std::vector<uint8_t>& state)
+{
+	//tried on machine 0 first so a bad state never becomes the reset point, machine 0 is reset to it
+	if (machines.empty() || !machines[0]->loadState(state))
+		return false;
+	snapshot = state;
+	return true;
+}
+
+void VectorEnv::reset(size_t env)
+{
+	if (snapshot.empty() || !machines[env]->loadState(snapshot))
+		machines[env]->reset();
+}
+
+void VectorEnv::reset()
+{
+	for (size_t i = 0; i < machines.size(); i++)
+		reset(i);
+}
+
+void VectorEnv::step(const uint8_t* pad1, const uint8_t* pad2, unsigned frames)
+{
+	//a few jobs per worker so a slow machine doesn't hold up a whole share of the batch
+	size_t jobs = std::min(machines.size(), pool.size() * 4);
+	for (size_t job = 0; job < jobs; job++)
+	{
+		size_t first = machines.size() * job / jobs;
+		size_t last = machines.size() * (job + 1) / jobs;
+		pool.submit([=] { runRange(first, last, pad1, pad2, frames); });
+	}
+	pool.wait();
+}
+
+void VectorEnv::runRange(size_t first, size_t last, const uint8_t* pad1, const uint8_t* pad2, unsigned frames)
+{
+	for (size_t env = first; env < last; env++)
+	{
+		Bus& bus = *machines[env];
+		bus.controller[0] = pad1 != nullptr ? pad1[env] : 0;
+		bus.controller[1] = pad2 != nullptr ? pad2[env] : 0;
+
+		bus.ppu.setRendering(false);
+		for (unsigned i = 1; i < frames; i++)
+			bus.runFrame();
+		bus.ppu.setRendering(true);
+		bus.runFrame();
+
+		observe(env);
+	}
+}
+
+void VectorEnv::observe(size_t env)
+{
+	const uint8_t* frame = machines[env]->ppu.getFrameBuffer();
+	uint8_t* out = observationBuffer.data() + env * observationWidth() * observationHeight();
+	unsigned d = options.downsample;
+
+	for (unsigned y = 0; y < observationHeight(); y++)
+	{
+		const uint8_t* row = frame + y * d * nes2c02::SCREEN_WIDTH;
+		for (unsigned x = 0; x < observationWidth(); x++)
+		{
+			if (!options.greyscale)
+			{
+				*out++ = row[x * d];
+				continue;
+			}
+
+			unsigned sum = 0;
+			for (unsigned by = 0; by < d; by++)
+				for (unsigned bx = 0; bx < d; bx++)
+					sum += luminance[row[by * nes2c02::SCREEN_WIDTH + x * d + bx] & 0x3F];
+			*out++ = (uint8_t)(sum / (d * d));
+		}
+	}
+}
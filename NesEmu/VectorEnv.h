@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cinttypes>
+#include <memory>
+#include <vector>
+
+#include "Bus.h"
+
+class ThreadPool;
+
+struct ObservationOptions
+{
+	//palette indices are replaced by their luminance
+	bool greyscale = false;
+	//1, 2 or 4: keep every nth pixel in each direction, greyscale averages the block instead
+	unsigned downsample = 1;
+};
+
+//A batch of machines running the same cartridge, stepped together for training loops.
+//Every machine has its own fork of the cartridge, so the rom is loaded once and shared.
+//ram() and frame() point straight into the machines, observations() is one contiguous
+//count * observationHeight() * observationWidth() buffer refreshed by every step.
+//The views stay valid until the VectorEnv is destroyed.
+class VectorEnv
+{
+private:
+	std::vector<std::unique_ptr<Bus>> machines;
+	ThreadPool& pool;
+	ObservationOptions options;
+	std::vector<uint8_t> snapshot;
+	std::vector<uint8_t> observationBuffer;
+
+	void runRange(size_t first, size_t last, const uint8_t* pad1, const uint8_t* pad2, unsigned frames);
+	void observe(size_t env);
+
+public:
+	VectorEnv(std::shared_ptr<Cartridge> cartridge, size_t count, ThreadPool& pool, ObservationOptions options = {});
+
+	//the state reset() goes back to, taken from one of the machines or from a save state
+	void captureSnapshot(size_t env);
+	bool setSnapshot(const std::vector<uint8_t>& state);
+	//all machines, or just one, back to the snapshot. Without a snapshot this is a power-on reset.
+	void reset();
+	void reset(size_t env);
+
+	//advances every machine frames frames, pad1/pad2 hold one byte per machine (pad2 may be null).
+	//Only the last of the frames is rendered.
+	void step(const uint8_t* pad1, const uint8_t* pad2 = nullptr, unsigned frames = 1);
+
+	size_t size() const { return machines.size(); }
+	Bus& machine(size_t env) { return *machines[env]; }
+
+	const uint8_t* ram(size_t env) const { return machines[env]->getRam().data(); }
+	//palette indices, SCREEN_WIDTH * SCREEN_HEIGHT, null before the first step
+	const uint8_t* frame(size_t env) const { return machines[env]->ppu.getFrameBuffer(); }
+
+	unsigned observationWidth() const { return nes2c02::SCREEN_WIDTH / options.downsample; }
+	unsigned observationHeight() const { return nes2c02::SCREEN_HEIGHT / options.downsample; }
+	const uint8_t* observations() const { return observationBuffer.data(); }
+	const uint8_t* observation(size_t env) const { return observationBuffer.data() + env * observationWidth() * observationHeight(); }
+};
@@ -0,0 +1,231 @@
+#include "VramViewer.h"
+
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	constexpr unsigned NAME_WIDTH = 512;
+	constexpr unsigned NAME_HEIGHT = 480;
+	constexpr unsigned PATTERN_WIDTH = 256;
+	constexpr unsigned PATTERN_HEIGHT = 128;
+	//more changed tiles than this and both pattern tables go up as one upload
+	constexpr int TILE_UPLOADS = 64;
+	//heat halves about every 0.2 s
+	constexpr float HEAT_FADE = 3.5f;
+
+	void putColor(uint8_t* out, const uint8_t* palette, uint8_t index)
+	{
+		std::memcpy(out, nes2c02::ppuPalette[palette[index] & 0x3F], 4);
+	}
+}
+
+void VramViewer::capture(nes2c02& ppu, Snapshot& snapshot, uint64_t sequence)
+{
+	ppu.readVram(snapshot.pattern, snapshot.nameTable, snapshot.palette);
+	snapshot.vertical = ppu.verticalMirroring();
+	snapshot.backgroundTable = ppu.backgroundPatternTable();
+	snapshot.dirty = ppu.takeDirty();
+	snapshot.sequence = sequence;
+}
+
+void VramViewer::create()
+{
+	nameTexture.create(NAME_WIDTH, NAME_HEIGHT);
+	patternTexture.create(PATTERN_WIDTH, PATTERN_HEIGHT);
+	names.setTexture(nameTexture, true);
+	names.setScale(NAME_SCALE, NAME_SCALE);
+	patterns.setTexture(patternTexture, true);
+	patterns.setScale(PATTERN_SCALE, PATTERN_SCALE);
+	pixels.assign(PATTERN_WIDTH * PATTERN_HEIGHT * 4, 0);
+}
+
+void VramViewer::decodeTile(const Snapshot& snapshot, int tile, uint8_t* out, size_t stride)
+{
+	//pattern tables are shown in background palette 0
+	const uint8_t* plane = &snapshot.pattern[tile * 16];
+	for (int y = 0; y < 8; y++)
+	{
+		uint8_t* line = out + y * stride;
+		for (int x = 0; x < 8; x++)
+		{
+			uint8_t pixel = (((plane[y + 8] >> (7 - x)) & 1) << 1) | ((plane[y] >> (7 - x)) & 1);
+			putColor(line + x * 4, snapshot.palette, pixel);
+		}
+	}
+}
+
+void VramViewer::decodeRow(const Snapshot& snapshot, int table, int row)
+{
+	const uint8_t* nameTable = snapshot.nameTable[table];
+	const uint8_t* patternTable = &snapshot.pattern[snapshot.backgroundTable ? 0x1000 : 0];
+	for (int column = 0; column < 32; column++)
+	{
+		uint8_t attribute = nameTable[960 + (row >> 2) * 8 + (column >> 2)];
+		uint8_t palette = (attribute >> (((row & 2) << 1) | (column & 2))) & 0x03;
+		const uint8_t* plane = &patternTable[nameTable[row * 32 + column] * 16];
+		for (int y = 0; y < 8; y++)
+		{
+			uint8_t* line = &pixels[(y * 256 + column * 8) * 4];
+			for (int x = 0; x < 8; x++)
+			{
+				uint8_t pixel = (((plane[y + 8] >> (7 - x)) & 1) << 1) | ((plane[y] >> (7 - x)) & 1);
+				//colour 0 of every palette shows the backdrop, as on screen
+				putColor(line + x * 4, snapshot.palette, pixel ? (palette << 2) | pixel : 0);
+			}
+		}
+	}
+
+	//every logical name table that mirrors this physical one
+	for (unsigned logical = 0; logical < 4; logical++)
+	{
+		int physical = vertical ? logical & 1 : logical >> 1;
+		if (physical == table)
+			nameTexture.update(pixels.data(), 256, 8, (logical & 1) * 256, (logical >> 1) * 240 + row * 8);
+	}
+	decodedPixels += 256 * 8;
+}
+
+void VramViewer::decodePatterns(const Snapshot& snapshot, const uint64_t* tiles)
+{
+	int count = 0;
+	for (int i = 0; i < 8; i++)
+	{
+		for (uint64_t bits = tiles[i]; bits != 0; bits &= bits - 1)
+			count++;
+	}
+	if (count == 0)
+		return;
+
+	if (count > TILE_UPLOADS)
+	{
+		for (int tile = 0; tile < 512; tile++)
+		{
+			int x = (tile >> 8) * 128 + (tile & 15) * 8;
+			int y = ((tile >> 4) & 15) * 8;
+			decodeTile(snapshot, tile, &pixels[(y * PATTERN_WIDTH + x) * 4], PATTERN_WIDTH * 4);
+		}
+		patternTexture.update(pixels.data());
+		decodedPixels += PATTERN_WIDTH * PATTERN_HEIGHT;
+		return;
+	}
+
+	for (int tile = 0; tile < 512; tile++)
+	{
+		if ((tiles[tile >> 6] >> (tile & 63)) & 1)
+		{
+			decodeTile(snapshot, tile, pixels.data(), 8 * 4);
+			patternTexture.update(pixels.data(), 8, 8, (tile >> 8) * 128 + (tile & 15) * 8, ((tile >> 4) & 15) * 8);
+			decodedPixels += 64;
+		}
+	}
+}
+
+void VramViewer::update(const Snapshot& snapshot)
+{
+	if (decoded && snapshot.sequence == lastSequence)
+		return;
+
+	decodedPixels = 0;
+	const nes2c02::VramDirty& dirty = snapshot.dirty;
+	//a frame was skipped, the mirroring or background table switched: nothing decoded still holds
+	bool full = !decoded || snapshot.sequence != lastSequence + 1 || snapshot.vertical != vertical || snapshot.backgroundTable != backgroundTable;
+	lastSequence = snapshot.sequence;
+	vertical = snapshot.vertical;
+	backgroundTable = snapshot.backgroundTable;
+	decoded = true;
+
+	//heat only follows what the ppu wrote, not what a full redraw touches
+	float fade = std::exp(-HEAT_FADE * heatClock.restart().asSeconds());
+	for (int table = 0; table < 2; table++)
+	{
+		for (int row = 0; row < 30; row++)
+		{
+			nameHeat[table][row] *= fade;
+			bool written = (dirty.nameRows[table] >> row) & 1 || (dirty.attributes[table] >> ((row >> 2) * 8)) & 0xFF;
+			if (written)
+				nameHeat[table][row] = 1.0f;
+		}
+	}
+	for (int tile = 0; tile < 512; tile++)
+	{
+		tileHeat[tile] *= fade;
+		if ((dirty.tiles[tile >> 6] >> (tile & 63)) & 1)
+			tileHeat[tile] = 1.0f;
+	}
+
+	//rows showing a background palette entry or a tile of the background table that changed
+	uint32_t backgroundTiles = backgroundTable ? 4 : 0;
+	bool allRows = full || (dirty.palette & 0xFFFF) != 0;
+	for (uint32_t i = backgroundTiles; i < backgroundTiles + 4; i++)
+		allRows = allRows || dirty.tiles[i] != 0;
+
+	for (int table = 0; table < 2; table++)
+	{
+		uint32_t rows = dirty.nameRows[table];
+		for (uint64_t bits = dirty.attributes[table]; bits != 0; bits &= bits - 1)
+		{
+			int attribute = 0;
+			while (!((bits >> attribute) & 1))
+				attribute++;
+			rows |= 0x0Fu << ((attribute >> 3) * 4);
+		}
+		if (allRows)
+			rows = ~0u;
+
+		for (int row = 0; row < 30; row++)
+		{
+			if ((rows >> row) & 1)
+				decodeRow(snapshot, table, row);
+		}
+	}
+
+	//the pattern tables are drawn in background palette 0
+	uint64_t allTiles[8] = { ~0ull, ~0ull, ~0ull, ~0ull, ~0ull, ~0ull, ~0ull, ~0ull };
+	decodePatterns(snapshot, full || (dirty.palette & 0x0F) != 0 ? allTiles : dirty.tiles);
+}
+
+void VramViewer::buildHeat(float x, float y)
+{
+	heatQuads.clear();
+	auto quad = [&](float left, float top, float width, float height, float heat)
+	{
+		sf::Color color(255, 40, 0, (sf::Uint8)(heat * 160.0f));
+		heatQuads.append(sf::Vertex(sf::Vector2f(left, top), color));
+		heatQuads.append(sf::Vertex(sf::Vector2f(left + width, top), color));
+		heatQuads.append(sf::Vertex(sf::Vector2f(left + width, top + height), color));
+		heatQuads.append(sf::Vertex(sf::Vector2f(left, top + height), color));
+	};
+
+	for (unsigned logical = 0; logical < 4; logical++)
+	{
+		int physical = vertical ? logical & 1 : logical >> 1;
+		for (int row = 0; row < 30; row++)
+		{
+			float heat = nameHeat[physical][row];
+			if (heat > 0.02f)
+				quad(x + (logical & 1) * 256 * NAME_SCALE, y + ((logical >> 1) * 240 + row * 8) * NAME_SCALE, 256 * NAME_SCALE, 8 * NAME_SCALE, heat);
+		}
+	}
+
+	float patternX = x + NAME_WIDTH * NAME_SCALE + 8;
+	for (int tile = 0; tile < 512; tile++)
+	{
+		if (tileHeat[tile] > 0.02f)
+			quad(patternX + ((tile >> 8) * 128 + (tile & 15) * 8) * PATTERN_SCALE, y + ((tile >> 4) & 15) * 8 * PATTERN_SCALE,
+				8 * PATTERN_SCALE, 8 * PATTERN_SCALE, tileHeat[tile]);
+	}
+}
+
+void VramViewer::draw(sf::RenderTarget& target, float x, float y, bool heat)
+{
+	names.setPosition(x, y);
+	patterns.setPosition(x + NAME_WIDTH * NAME_SCALE + 8, y);
+	target.draw(names);
+	target.draw(patterns);
+	if (heat)
+	{
+		buildHeat(x, y);
+		target.draw(heatQuads);
+	}
+}
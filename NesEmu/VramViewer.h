@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cinttypes>
+#include <SFML/Graphics.hpp>
+
+#include "nes2c02.h"
+
+//Name table and pattern table viewers for the debugger window.
+//Both live in textures that are kept between frames, only what the ppu marked changed is decoded
+//and uploaded again: tile rows of a name table (an attribute byte covers four of them) and single
+//chr tiles. Palette changes and chr changes under the background redo every row, there is no tile
+//to row index to narrow them. With heat on, every region the ppu wrote lights up and fades over
+//about a second, which shows what a game rewrites every frame.
+class VramViewer
+{
+public:
+	//what the viewer needs of one frame, taken along with it on the emulation thread
+	struct Snapshot
+	{
+		uint8_t pattern[0x2000];
+		uint8_t nameTable[2][1024];
+		uint8_t palette[32];
+		bool vertical;
+		uint8_t backgroundTable;
+		nes2c02::VramDirty dirty;
+		//counts snapshots, a gap means the changes of frames that were never shown are missing
+		uint64_t sequence;
+	};
+
+	//nametables at a quarter of their size, pattern tables scaled to the same height
+	static constexpr float NAME_SCALE = 0.25f;
+	static constexpr float PATTERN_SCALE = 120.0f / 128.0f;
+	static constexpr float HEIGHT = 120.0f;
+
+private:
+	sf::Texture nameTexture;
+	sf::Texture patternTexture;
+	sf::Sprite names;
+	sf::Sprite patterns;
+	sf::VertexArray heatQuads{ sf::Quads };
+	//one decoded tile row of a name table, or one tile or the whole of both pattern tables
+	std::vector<uint8_t> pixels;
+
+	uint64_t lastSequence = 0;
+	bool decoded = false;
+	bool vertical = false;
+	uint8_t backgroundTable = 0;
+
+	float nameHeat[2][30] = {};
+	float tileHeat[512] = {};
+	sf::Clock heatClock;
+	//pixels decoded by the last update(), for the panel
+	size_t decodedPixels = 0;
+
+	void decodeRow(const Snapshot& snapshot, int table, int row);
+	void decodeTile(const Snapshot& snapshot, int tile, uint8_t* out, size_t stride);
+	void decodePatterns(const Snapshot& snapshot, const uint64_t* tiles);
+	void buildHeat(float x, float y);
+
+public:
+	static void capture(nes2c02& ppu, Snapshot& snapshot, uint64_t sequence);
+
+	void create();
+	//decodes what changed since the snapshot before, a snapshot seen before changes nothing
+	void update(const Snapshot& snapshot);
+	void draw(sf::RenderTarget& target, float x, float y, bool heat);
+	size_t lastDecoded() const { return decodedPixels; }
+};
@@ -0,0 +1,566 @@
+#include "nes2a03.h"
+#include "Bus.h"
+#include "SaveState.h"
+
+#include <algorithm>
+
+namespace
+{
+	const uint8_t lengthTable[32] = {
+		10, 254, 20, 2, 40, 4, 80, 6, 160, 8, 60, 10, 14, 12, 26, 14,
+		12, 16, 24, 18, 48, 20, 96, 22, 192, 24, 72, 26, 16, 28, 32, 30
+	};
+
+	const uint8_t dutyTable[4][8] = {
+		{ 0, 1, 0, 0, 0, 0, 0, 0 },
+		{ 0, 1, 1, 0, 0, 0, 0, 0 },
+		{ 0, 1, 1, 1, 1, 0, 0, 0 },
+		{ 1, 0, 0, 1, 1, 1, 1, 1 }
+	};
+
+	const uint8_t triangleTable[32] = {
+		15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+		0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15
+	};
+
+	//NTSC, in cpu cycles
+	const uint16_t noisePeriods[16] = { 4, 8, 16, 32, 64, 96, 128, 160, 202, 254, 380, 508, 762, 1016, 2034, 4068 };
+	const uint16_t dmcRates[16] = { 428, 380, 340, 320, 286, 254, 226, 214, 190, 160, 142, 128, 106, 84, 72, 54 };
+
+	//cpu cycles of the frame counter steps after the sequence starts, and the sequence lengths
+	const uint32_t frameSteps[2][4] = { { 7457, 14913, 22371, 29829 }, { 7457, 14913, 22371, 37281 } };
+	const uint32_t frameLength[2] = { 29830, 37282 };
+
+	//the nonlinear 2A03 mixer as two lookup tables, pulse1 + pulse2 and 3 * triangle + 2 * noise + dmc
+	struct MixerTables
+	{
+		float pulse[31];
+		float tnd[203];
+
+		MixerTables()
+		{
+			pulse[0] = 0.0f;
+			for (int i = 1; i < 31; i++)
+				pulse[i] = 95.52f / (8128.0f / i + 100.0f);
+			tnd[0] = 0.0f;
+			for (int i = 1; i < 203; i++)
+				tnd[i] = 163.67f / (24329.0f / i + 100.0f);
+		}
+	};
+	const MixerTables mixer;
+
+	//runs a timer for elapsed cycles, returns how often it expired
+	uint64_t advance(uint32_t& timer, uint32_t period, uint64_t elapsed)
+	{
+		if (elapsed < timer)
+		{
+			timer -= (uint32_t)elapsed;
+			return 0;
+		}
+		uint64_t over = elapsed - timer;
+		timer = period - (uint32_t)(over % period);
+		return 1 + over / period;
+	}
+}
+
+nes2a03::nes2a03(Bus* bus, unsigned sampleRate)
+	: bus(bus), buffer(CPU_CLOCK_RATE, sampleRate, sampleRate / 2)
+{
+	reset();
+}
+
+void nes2a03::reset()
+{
+	state = {};
+	state.noise.shift = 1;
+	state.noise.period = noisePeriods[0];
+	state.dmc.rate = dmcRates[0];
+	state.dmc.sampleAddress = 0xC000;
+	state.dmc.sampleLength = 1;
+	state.dmc.bitsRemaining = 8;
+	state.dmc.silence = true;
+	state.pulse[0].timer = state.pulse[1].timer = state.triangle.timer = state.noise.timer = state.dmc.timer = 1;
+
+	mixed = mix();
+	bufferStart = 0;
+	buffer.discardFrame();
+}
+
+namespace
+{
+	template <typename Envelope>
+	uint8_t volumeOf(const Envelope& envelope)
+	{
+		return envelope.constant ? envelope.period : envelope.decay;
+	}
+
+	template <typename Envelope>
+	void clockEnvelope(Envelope& envelope)
+	{
+		if (envelope.start)
+		{
+			envelope.start = false;
+			envelope.decay = 15;
+			envelope.divider = envelope.period;
+		}
+		else if (envelope.divider == 0)
+		{
+			envelope.divider = envelope.period;
+			if (envelope.decay > 0)
+				envelope.decay--;
+			else if (envelope.loop)
+				envelope.decay = 15;
+		}
+		else
+			envelope.divider--;
+	}
+
+	//period the sweep unit would set, pulse 1 negates with one's complement
+	template <typename Pulse>
+	int sweepTarget(const Pulse& pulse, int channel)
+	{
+		int change = pulse.period >> pulse.sweepShift;
+		if (pulse.sweepNegate)
+			return pulse.period - change - (channel == 0 ? 1 : 0);
+		return pulse.period + change;
+	}
+
+	template <typename Pulse>
+	bool pulseMuted(const Pulse& pulse, int channel)
+	{
+		return pulse.length == 0 || pulse.period < 8 || sweepTarget(pulse, channel) > 0x7FF || volumeOf(pulse.envelope) == 0;
+	}
+}
+
+float nes2a03::mix() const
+{
+	int pulse = 0;
+	for (int i = 0; i < 2; i++)
+	{
+		const Pulse& p = state.pulse[i];
+		if (!pulseMuted(p, i) && dutyTable[p.duty][p.step])
+			pulse += volumeOf(p.envelope);
+	}
+
+	const Noise& n = state.noise;
+	int noise = n.length > 0 && !(n.shift & 0x01) ? volumeOf(n.envelope) : 0;
+	return mixer.pulse[pulse] + mixer.tnd[3 * triangleTable[state.triangle.step] + 2 * noise + state.dmc.level];
+}
+
+void nes2a03::updateOutput()
+{
+	if (!outputEnabled)
+		return;
+
+	float level = mix();
+	if (level != mixed)
+	{
+		buffer.addDelta((uint32_t)(state.time - bufferStart), level - mixed);
+		mixed = level;
+	}
+}
+
+void nes2a03::dmcFetch()
+{
+	Dmc& d = state.dmc;
+	if (d.bufferFull || d.bytesRemaining == 0)
+		return;
+
+	//the real dmc steals cpu cycles for this read, the stall isn't emulated
+	d.buffer = bus->cpuRead(d.address);
+	d.bufferFull = true;
+	d.address = d.address == 0xFFFF ? 0x8000 : d.address + 1;
+	if (--d.bytesRemaining == 0)
+	{
+		if (d.loop)
+		{
+			d.address = d.sampleAddress;
+			d.bytesRemaining = d.sampleLength;
+		}
+		else if (d.irqEnabled)
+			state.dmcIrq = true;
+	}
+}
+
+void nes2a03::runChannels(uint64_t end)
+{
+	enum { PULSE1, PULSE2, TRIANGLE, NOISE, DMC, CHANNELS };
+
+	uint64_t elapsed = end - state.time;
+	Pulse* pulse = state.pulse;
+	Triangle& t = state.triangle;
+	Noise& n = state.noise;
+	Dmc& d = state.dmc;
+
+	uint32_t periods[CHANNELS] = {
+		(pulse[0].period + 1u) * 2, (pulse[1].period + 1u) * 2, t.period + 1u, n.period, d.rate
+	};
+	uint32_t* timers[CHANNELS] = { &pulse[0].timer, &pulse[1].timer, &t.timer, &n.timer, &d.timer };
+
+	//channels whose level can't change until the next register write or frame counter step only
+	//have their timers and sequencers moved forward, the rest go through the edge by edge loop below
+	bool triangleRunning = t.length > 0 && t.linearCounter > 0 && t.period >= 2;
+	bool active[CHANNELS] = {
+		outputEnabled && !pulseMuted(pulse[0], 0),
+		outputEnabled && !pulseMuted(pulse[1], 1),
+		outputEnabled && triangleRunning,
+		outputEnabled && n.length > 0 && volumeOf(n.envelope) > 0,
+		!(d.silence && !d.bufferFull && d.bytesRemaining == 0)
+	};
+
+	if (!active[PULSE1])
+		pulse[0].step = (pulse[0].step + advance(pulse[0].timer, periods[PULSE1], elapsed)) & 0x07;
+	if (!active[PULSE2])
+		pulse[1].step = (pulse[1].step + advance(pulse[1].timer, periods[PULSE2], elapsed)) & 0x07;
+	if (!active[TRIANGLE])
+	{
+		uint64_t steps = advance(t.timer, periods[TRIANGLE], elapsed);
+		if (triangleRunning)
+			t.step = (t.step + steps) & 0x1F;
+	}
+	if (!active[NOISE])
+	{
+		for (uint64_t steps = advance(n.timer, periods[NOISE], elapsed); steps > 0; steps--)
+			n.shift = (n.shift >> 1) | (((n.shift ^ (n.shift >> (n.mode ? 6 : 1))) & 0x01) << 14);
+	}
+	if (!active[DMC])
+	{
+		//idle dmc: only the bit counter moves, the output level stays where it is
+		uint64_t steps = advance(d.timer, periods[DMC], elapsed) % 8;
+		d.bitsRemaining = (uint8_t)((d.bitsRemaining - 1 + 8 - steps) % 8 + 1);
+	}
+
+	uint64_t next[CHANNELS];
+	for (int i = 0; i < CHANNELS; i++)
+		next[i] = active[i] ? state.time + *timers[i] : UINT64_MAX;
+
+	for (;;)
+	{
+		int channel = (int)(std::min_element(next, next + CHANNELS) - next);
+		uint64_t when = next[channel];
+		if (when > end)
+			break;
+		next[channel] += periods[channel];
+
+		switch (channel)
+		{
+		case PULSE1:
+		case PULSE2:
+			pulse[channel].step = (pulse[channel].step + 1) & 0x07;
+			break;
+		case TRIANGLE:
+			t.step = (t.step + 1) & 0x1F;
+			break;
+		case NOISE:
+			n.shift = (n.shift >> 1) | (((n.shift ^ (n.shift >> (n.mode ? 6 : 1))) & 0x01) << 14);
+			break;
+		case DMC:
+			if (!d.silence)
+			{
+				if (d.shift & 0x01)
+				{
+					if (d.level <= 125)
+						d.level += 2;
+				}
+				else if (d.level >= 2)
+					d.level -= 2;
+				d.shift >>= 1;
+			}
+			if (--d.bitsRemaining == 0)
+			{
+				d.bitsRemaining = 8;
+				d.silence = !d.bufferFull;
+				if (d.bufferFull)
+				{
+					d.shift = d.buffer;
+					d.bufferFull = false;
+					dmcFetch();
+				}
+			}
+			break;
+		}
+
+		if (outputEnabled)
+		{
+			float level = mix();
+			if (level != mixed)
+			{
+				buffer.addDelta((uint32_t)(when - bufferStart), level - mixed);
+				mixed = level;
+			}
+		}
+	}
+
+	for (int i = 0; i < CHANNELS; i++)
+	{
+		if (active[i])
+			*timers[i] = (uint32_t)(next[i] - end);
+	}
+	state.time = end;
+}
+
+void nes2a03::quarterFrame()
+{
+	clockEnvelope(state.pulse[0].envelope);
+	clockEnvelope(state.pulse[1].envelope);
+	clockEnvelope(state.noise.envelope);
+
+	Triangle& t = state.triangle;
+	if (t.linearReload)
+		t.linearCounter = t.linearPeriod;
+	else if (t.linearCounter > 0)
+		t.linearCounter--;
+	if (!t.control)
+		t.linearReload = false;
+}
+
+void nes2a03::halfFrame()
+{
+	for (int i = 0; i < 2; i++)
+	{
+		Pulse& p = state.pulse[i];
+		if (p.length > 0 && !p.envelope.loop)
+			p.length--;
+
+		int target = sweepTarget(p, i);
+		if (p.sweepDivider == 0 && p.sweepEnabled && p.sweepShift > 0 && p.period >= 8 && target <= 0x7FF)
+			p.period = (uint16_t)target;
+		if (p.sweepDivider == 0 || p.sweepReload)
+		{
+			p.sweepDivider = p.sweepPeriod;
+			p.sweepReload = false;
+		}
+		else
+			p.sweepDivider--;
+	}
+
+	if (state.triangle.length > 0 && !state.triangle.control)
+		state.triangle.length--;
+	if (state.noise.length > 0 && !state.noise.envelope.loop)
+		state.noise.length--;
+}
+
+uint64_t nes2a03::frameEvent() const
+{
+	return state.frameStart + frameSteps[state.fiveStep][state.frameStep];
+}
+
+void nes2a03::clockFrameCounter()
+{
+	quarterFrame();
+	if (state.frameStep == 1 || state.frameStep == 3)
+		halfFrame();
+	if (state.frameStep == 3 && !state.fiveStep && !state.irqInhibit)
+		state.frameIrq = true;
+
+	if (++state.frameStep == 4)
+	{
+		state.frameStep = 0;
+		state.frameStart += frameLength[state.fiveStep];
+	}
+	updateOutput();
+}
+
+uint64_t nes2a03::nextEvent() const
+{
+	uint64_t next = frameEvent();
+
+	//the dmc irq comes with the fetch of the last byte, which happens when the output unit
+	//takes the byte before it out of the buffer
+	const Dmc& d = state.dmc;
+	if (d.irqEnabled && !d.loop && d.bytesRemaining > 0)
+	{
+		uint64_t fetch = state.time;
+		if (d.bufferFull)
+			fetch += d.timer + uint64_t(d.bitsRemaining - 1) * d.rate + uint64_t(d.bytesRemaining - 1) * 8 * d.rate;
+		next = std::min(next, fetch);
+	}
+	return next;
+}
+
+void nes2a03::run(uint64_t cycle)
+{
+	while (state.time < cycle)
+	{
+		uint64_t event = frameEvent();
+		runChannels(std::min(cycle, event));
+		if (state.time == event)
+			clockFrameCounter();
+	}
+
+	if (outputEnabled)
+	{
+		buffer.endFrame((uint32_t)(state.time - bufferStart));
+		bufferStart = state.time;
+	}
+}
+
+void nes2a03::cpuWrite(uint16_t addr, uint8_t data, uint64_t cycle)
+{
+	run(cycle);
+
+	Pulse& p = state.pulse[(addr >> 2) & 0x01];
+	Triangle& t = state.triangle;
+	Noise& n = state.noise;
+	Dmc& d = state.dmc;
+
+	switch (addr)
+	{
+	case 0x4000:
+	case 0x4004:
+		p.duty = data >> 6;
+		p.envelope.loop = data & 0x20;
+		p.envelope.constant = data & 0x10;
+		p.envelope.period = data & 0x0F;
+		break;
+	case 0x4001:
+	case 0x4005:
+		p.sweepEnabled = data & 0x80;
+		p.sweepPeriod = (data >> 4) & 0x07;
+		p.sweepNegate = data & 0x08;
+		p.sweepShift = data & 0x07;
+		p.sweepReload = true;
+		break;
+	case 0x4002:
+	case 0x4006:
+		p.period = (p.period & 0x0700) | data;
+		break;
+	case 0x4003:
+	case 0x4007:
+		p.period = (p.period & 0x00FF) | ((data & 0x07) << 8);
+		if (state.enabled & (1 << ((addr >> 2) & 0x01)))
+			p.length = lengthTable[data >> 3];
+		p.step = 0;
+		p.envelope.start = true;
+		break;
+	case 0x4008:
+		t.control = data & 0x80;
+		t.linearPeriod = data & 0x7F;
+		break;
+	case 0x400A:
+		t.period = (t.period & 0x0700) | data;
+		break;
+	case 0x400B:
+		t.period = (t.period & 0x00FF) | ((data & 0x07) << 8);
+		if (state.enabled & 0x04)
+			t.length = lengthTable[data >> 3];
+		t.linearReload = true;
+		break;
+	case 0x400C:
+		n.envelope.loop = data & 0x20;
+		n.envelope.constant = data & 0x10;
+		n.envelope.period = data & 0x0F;
+		break;
+	case 0x400E:
+		n.mode = data & 0x80;
+		n.period = noisePeriods[data & 0x0F];
+		break;
+	case 0x400F:
+		if (state.enabled & 0x08)
+			n.length = lengthTable[data >> 3];
+		n.envelope.start = true;
+		break;
+	case 0x4010:
+		d.irqEnabled = data & 0x80;
+		d.loop = data & 0x40;
+		d.rate = dmcRates[data & 0x0F];
+		if (!d.irqEnabled)
+			state.dmcIrq = false;
+		break;
+	case 0x4011:
+		d.level = data & 0x7F;
+		break;
+	case 0x4012:
+		d.sampleAddress = 0xC000 + data * 64;
+		break;
+	case 0x4013:
+		d.sampleLength = data * 16 + 1;
+		break;
+	case 0x4015:
+		state.dmcIrq = false;
+		state.enabled = data & 0x1F;
+		if (!(data & 0x01)) state.pulse[0].length = 0;
+		if (!(data & 0x02)) state.pulse[1].length = 0;
+		if (!(data & 0x04)) t.length = 0;
+		if (!(data & 0x08)) n.length = 0;
+		if (!(data & 0x10))
+			d.bytesRemaining = 0;
+		else if (d.bytesRemaining == 0)
+		{
+			d.address = d.sampleAddress;
+			d.bytesRemaining = d.sampleLength;
+			dmcFetch();
+		}
+		break;
+	case 0x4017:
+		state.fiveStep = data & 0x80;
+		state.irqInhibit = data & 0x40;
+		if (state.irqInhibit)
+			state.frameIrq = false;
+		state.frameStart = cycle;
+		state.frameStep = 0;
+		if (state.fiveStep)
+		{
+			quarterFrame();
+			halfFrame();
+		}
+		break;
+	}
+
+	updateOutput();
+}
+
+uint8_t nes2a03::cpuRead(uint16_t addr, uint64_t cycle)
+{
+	if (addr != 0x4015)
+		return 0;
+
+	run(cycle);
+	uint8_t data = (state.pulse[0].length > 0 ? 0x01 : 0) | (state.pulse[1].length > 0 ? 0x02 : 0) |
+		(state.triangle.length > 0 ? 0x04 : 0) | (state.noise.length > 0 ? 0x08 : 0) |
+		(state.dmc.bytesRemaining > 0 ? 0x10 : 0) | (state.frameIrq ? 0x40 : 0) | (state.dmcIrq ? 0x80 : 0);
+	state.frameIrq = false;
+	return data;
+}
+
+void nes2a03::setOutput(bool enabled)
+{
+	if (enabled == outputEnabled)
+		return;
+
+	//coming back on, the buffer picks up from the level the channels have now
+	outputEnabled = enabled;
+	if (enabled)
+	{
+		bufferStart = state.time;
+		mixed = mix();
+	}
+}
+
+void nes2a03::setSampleRate(unsigned sampleRate)
+{
+	buffer.setRates(CPU_CLOCK_RATE, sampleRate);
+}
+
+void nes2a03::saveState(StateWriter& writer) const
+{
+	writer.write("APU ", 1, state);
+}
+
+bool nes2a03::loadState(const StateReader& reader)
+{
+	uint64_t bufferEnd = bufferStart;
+	//states saved before the apu existed don't have it, it starts from power on
+	if (!reader.contains("APU "))
+		reset();
+	else if (!reader.read("APU ", 1, state))
+		return false;
+
+	//deltas past the loaded time belong to a future that didn't happen. Run-ahead loads back to
+	//where the buffer ends (nothing went in while it ran ahead), the pending tails there are real.
+	if (state.time != bufferEnd)
+		buffer.discardFrame();
+	bufferStart = state.time;
+	mixed = mix();
+	return true;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cinttypes>
+
+#include "BandLimitedBuffer.h"
+
+class Bus;
+class StateWriter;
+class StateReader;
+
+//2A03 sound: two pulse channels, triangle, noise, DMC and the frame counter.
+//The apu is not clocked with the cpu. Register writes and $4015 reads carry the cpu cycle they
+//happen on and first run the apu up to it, and the bus runs it whenever nextEvent() comes due
+//(the next frame counter step or a possible DMC IRQ). Running jumps from one channel timer expiry
+//to the next and only adds a delta to the band-limited buffer when the mixed level changes, so
+//audio costs per output sample and per waveform edge instead of per cpu cycle.
+class nes2a03
+{
+public:
+	//NTSC cpu clock
+	static constexpr double CPU_CLOCK_RATE = 1789772.7272727;
+
+private:
+	struct Envelope
+	{
+		bool start, loop, constant;
+		uint8_t period, divider, decay;
+	};
+
+	struct Pulse
+	{
+		Envelope envelope;
+		uint8_t duty, step, length;
+		bool sweepEnabled, sweepNegate, sweepReload;
+		uint8_t sweepPeriod, sweepShift, sweepDivider;
+		uint16_t period;
+		uint32_t timer;
+	};
+
+	struct Triangle
+	{
+		bool control, linearReload;
+		uint8_t linearPeriod, linearCounter, step, length;
+		uint16_t period;
+		uint32_t timer;
+	};
+
+	struct Noise
+	{
+		Envelope envelope;
+		bool mode;
+		uint8_t length;
+		uint16_t shift;
+		uint16_t period;
+		uint32_t timer;
+	};
+
+	struct Dmc
+	{
+		bool irqEnabled, loop, silence, bufferFull;
+		uint8_t level, shift, bitsRemaining, buffer;
+		uint16_t rate, sampleAddress, sampleLength, address, bytesRemaining;
+		uint32_t timer;
+	};
+
+	//everything saved, plain data so it goes into the state as one chunk
+	struct State
+	{
+		Pulse pulse[2];
+		Triangle triangle;
+		Noise noise;
+		Dmc dmc;
+		uint8_t enabled;
+		bool fiveStep, irqInhibit, frameIrq, dmcIrq;
+		uint8_t frameStep;
+		//cpu cycles since reset, time the apu has been run to, and start of the frame counter sequence
+		uint64_t time, frameStart;
+	} state;
+
+	Bus* bus = nullptr;
+
+	bool outputEnabled = true;
+	float volume = 0.5f;
+	//mixed level last put in the buffer and cpu cycle the buffer's frame starts on
+	float mixed = 0.0f;
+	uint64_t bufferStart = 0;
+	BandLimitedBuffer buffer;
+
+	uint64_t frameEvent() const;
+	void clockFrameCounter();
+	void quarterFrame();
+	void halfFrame();
+	void runChannels(uint64_t end);
+	float mix() const;
+	//adds the change of the mixed level at the current time
+	void updateOutput();
+	void dmcFetch();
+
+public:
+	nes2a03(Bus* bus, unsigned sampleRate = 48000);
+
+	void reset();
+
+	//cpu side, cycle is the cpu cycle the access happens on
+	void cpuWrite(uint16_t addr, uint8_t data, uint64_t cycle);
+	uint8_t cpuRead(uint16_t addr, uint64_t cycle);
+
+	//earliest cpu cycle the apu has something to do on its own, the bus calls run() from there
+	uint64_t nextEvent() const;
+	void run(uint64_t cycle);
+	//the irq line, frame counter or DMC
+	bool irq() const { return state.frameIrq || state.dmcIrq; }
+
+	//when disabled the apu keeps its timing, length counters and irqs but makes no samples
+	void setOutput(bool enabled);
+	void setSampleRate(unsigned sampleRate);
+	size_t samplesAvailable() const { return buffer.samplesAvailable(); }
+	size_t readSamples(int16_t* out, size_t count) { return buffer.readSamples(out, count, volume); }
+
+	//the sample buffer is not part of the state, samples not read yet stay readable
+	void saveState(StateWriter& writer) const;
+	bool loadState(const StateReader& reader);
+};
@@ -1,58 +1,47 @@
 #include "nes2c02.h"
 #include "Cartridge.h"
+#include "SaveState.h"
+#include "ScanlineRenderer.h"
 #include <iostream>
+#include <algorithm>
+#include <cstring>
 
 
 nes2c02::nes2c02()
 {
-	fine_x = 0x00;
-	addr_latch = 0x00;
-	ppu_data_buffer = 0x00;
-	status_reg.reg = 0x00;
-	mask_reg.reg = 0x00;
-	control_reg.reg = 0x00;
-	vram_addr.reg = 0x0000;
-	tram_addr.reg = 0x0000;
-	scanline = 0;
-	cycle = 0;
-	bg_next_attrib = 0;
-	bg_next_id = 0;
-	bg_next_pattern_high = 0;
-	bg_next_pattern_low = 0;
-	bg_shifter_attrib_high = 0x0000;
-	bg_shifter_attrib_low = 0x0000;
-	bg_shifter_pattern_high = 0x0000;
-	bg_shifter_pattern_low = 0x0000;
+	powerOn();
+}
 
-	for (int i = 0; i < 2; i++)
-	{
-		for (int j = 0; j < 1024; j++)
-		{
-			nameTable[i][j] = 128;
-		}
-	}
+nes2c02::~nes2c02() = default;
 
-	for (int i = 0; i < 2; i++)
-	{
-		for (int j = 0; j < 4096; j++)
-		{
-			patternTable[i][j] = 128;
-		}
-	}
+void nes2c02::insertCartridge(std::shared_ptr<Cartridge> cartridge)
+{
+	this->cartridge = cartridge;
+	dirty.markAll();
+}
 
-	for (int i = 0; i < 32; i++)
+void nes2c02::VramDirty::merge(const VramDirty& other)
+{
+	for (int i = 0; i < 2; i++)
 	{
-		paletteTable[i] = 0;
+		nameRows[i] |= other.nameRows[i];
+		attributes[i] |= other.attributes[i];
 	}
-
-	//fill the buffer with some color to determine its size
-	screenBuffer.create(256, 240, { 0,0,0,255 });
-
+	for (int i = 0; i < 8; i++)
+		tiles[i] |= other.tiles[i];
+	palette |= other.palette;
 }
 
-void nes2c02::insertCartridge(std::shared_ptr<Cartridge> cartridge)
+void nes2c02::VramDirty::markAll()
 {
-	this->cartridge = cartridge;
+	for (int i = 0; i < 2; i++)
+	{
+		nameRows[i] = (1u << 30) - 1;
+		attributes[i] = ~0ull;
+	}
+	for (int i = 0; i < 8; i++)
+		tiles[i] = ~0ull;
+	palette = ~0u;
 }
 
 void nes2c02::cpuWrite(uint16_t addr, uint8_t data)
@@ -71,8 +60,10 @@ void nes2c02::cpuWrite(uint16_t addr, uint8_t data)
 		//can't write into status reg
 		break;
 	case 0x0003:
+		oam_addr = data;
 		break;
 	case 0x0004:
+		oam[oam_addr++] = data;
 		break;
 	case 0x0005:
 		if (addr_latch == 0)
@@ -105,12 +96,17 @@ void nes2c02::cpuWrite(uint16_t addr, uint8_t data)
 		break;
 	case 0x0007:
 		ppuWrite(vram_addr.reg, data);
+		if (deferred)
+			logMemory(vram_addr.reg, data);
 
 		//check inc mode and inc vram
 		vram_addr.reg += (control_reg.inc_mode ? 32 : 1);
 		break;
 	}
 
+	//oam writes don't move anything the background is drawn from
+	if (deferred && addr != 0x0002 && addr != 0x0003 && addr != 0x0004)
+		logRegisters();
 }
 
 uint8_t nes2c02::cpuRead(uint16_t addr)
@@ -135,6 +131,7 @@ uint8_t nes2c02::cpuRead(uint16_t addr)
 	case 0x0003:
 		break;
 	case 0x0004:
+		data = oam[oam_addr];
 		break;
 	case 0x0005:
 		//scroll can't be read
@@ -152,6 +149,8 @@ uint8_t nes2c02::cpuRead(uint16_t addr)
 
 		//check inc mode and inc vram
 		vram_addr.reg += (control_reg.inc_mode ? 32 : 1);
+		if (deferred)
+			logRegisters();
 		break;
 	}
 
@@ -162,12 +161,20 @@ void nes2c02::ppuWrite(uint16_t addr, uint8_t data)
 {
 	addr &= 0x3FFF;
 
-	if (cartridge->ppuWrite(addr, data)) {}
+	if (cartridge->ppuWrite(addr, data))
+	{
+		if (addr <= 0x1FFF)
+			dirty.tiles[addr >> 10] |= 1ull << ((addr >> 4) & 63);
+	}
 	else if (addr >= 0x0000 && addr <= 0x1FFF)
 	{
-		size_t i = (addr & 0x1000) >> 12;
-		size_t j = addr & 0x0FFF;
-		patternTable[i][j] = data;
+		//chr rom rejects writes, only keep them when the cartridge does not map this range at all
+		uint8_t mapped = 0x00;
+		if (!cartridge->ppuRead(addr, mapped))
+		{
+			fallbackPatternTable()[addr] = data;
+			dirty.tiles[addr >> 10] |= 1ull << ((addr >> 4) & 63);
+		}
 	}
 	else if (addr >= 0x2000 && addr <= 0x3EFF)
 	{
@@ -186,6 +193,14 @@ void nes2c02::ppuWrite(uint16_t addr, uint8_t data)
 			if (addr >= 0x0800 && addr <= 0x0BFF) nameTable[1][addr & 0x03FF] = data;
 			if (addr >= 0x0C00 && addr <= 0x0FFF) nameTable[1][addr & 0x03FF] = data;
 		}
+
+		//the table the write above went to
+		int table = cartridge->mirror == Cartridge::Mirror::VERTICAL ? (addr >> 10) & 1 : (addr >> 11) & 1;
+		uint16_t offset = addr & 0x03FF;
+		if (offset < 960)
+			dirty.nameRows[table] |= 1u << (offset >> 5);
+		else
+			dirty.attributes[table] |= 1ull << (offset - 960);
 	}
 	else if (addr >= 0x3F00 && addr <= 0x3FFF)
 	{
@@ -196,6 +211,7 @@ void nes2c02::ppuWrite(uint16_t addr, uint8_t data)
 		if (addr == 0x0018) addr = 0x0008;
 		if (addr == 0x001C) addr = 0x000C;
 		paletteTable[addr] = data;
+		dirty.palette |= 1u << addr;
 	}
 }
 
@@ -208,7 +224,7 @@ uint8_t nes2c02::ppuRead(uint16_t addr)
 	else if (addr >= 0x0000 && addr <= 0x1FFF)
 	{
 		//if cartridge can't map
-		temp = patternTable[(addr & 0x1000) >> 12][addr & 0x0FFF];
+		temp = fallbackPatternTable()[addr];
 	}
 	else if (addr >= 0x2000 && addr <= 0x3EFF)
 	{
@@ -244,17 +260,206 @@ uint8_t nes2c02::ppuRead(uint16_t addr)
 	return temp;
 }
 
-//selects the right color from the palette and constructs a sf::color object
-sf::Color nes2c02::getColorFromPalette(uint8_t palette, uint8_t pixel)
+//selects the right color from the palette, returns its index into ppuPalette
+uint8_t nes2c02::getColorFromPalette(uint8_t palette, uint8_t pixel)
+{
+	return ppuRead(0x3F00 + (palette << 2) + pixel) & 0x3F;
+}
+
+uint8_t* nes2c02::fallbackPatternTable()
 {
-	uint8_t* selected_color = ppuPalette[ppuRead(0x3F00 + (palette << 2) + pixel) & 0x3F];
-	sf::Color color_obj(selected_color[0], selected_color[1], selected_color[2], selected_color[3]);
-	return color_obj;
+	if (!patternTable)
+	{
+		patternTable = std::make_unique<uint8_t[]>(2 * 4096);
+		std::fill_n(patternTable.get(), 2 * 4096, 128);
+	}
+	return patternTable.get();
 }
 
-sf::Image& nes2c02::getScreenBuffer()
+nes2c02::VramDirty nes2c02::takeDirty()
 {
-	return screenBuffer;
+	VramDirty taken = dirty;
+	dirty = {};
+	return taken;
+}
+
+void nes2c02::chrReplaced()
+{
+	if (cartridge->hasChrRam())
+	{
+		for (uint64_t& tiles : dirty.tiles)
+			tiles = ~0ull;
+	}
+}
+
+void nes2c02::readVram(uint8_t* pattern, uint8_t (*nameTables)[1024], uint8_t* palette)
+{
+	for (uint16_t addr = 0; addr < 0x2000; addr++)
+		pattern[addr] = ppuRead(addr);
+	std::memcpy(nameTables, nameTable, sizeof(nameTable));
+	std::memcpy(palette, paletteTable, sizeof(paletteTable));
+}
+
+bool nes2c02::verticalMirroring() const
+{
+	return cartridge->mirror == Cartridge::Mirror::VERTICAL;
+}
+
+uint32_t nes2c02::frameDot() const
+{
+	if (scanline < 0)
+		return cycle;
+	if (scanline == 0)
+		return 341 + (cycle > 0 ? cycle - 1 : 0);
+	return 341 + 340 + (scanline - 1) * 341 + cycle;
+}
+
+const uint8_t* nes2c02::getFrameBuffer() const
+{
+	if (deferred)
+		return deferred->frameBuffer();
+	return frameBuffer.get();
+}
+
+void nes2c02::setRendering(bool enabled)
+{
+	renderEnabled = enabled;
+	if (deferred && !enabled)
+		deferred->abort();
+}
+
+void nes2c02::setDeferredRendering(bool enabled, ThreadPool* pool)
+{
+	//a frame half logged is dropped, the next one starts at the pre-render line
+	deferred.reset();
+	if (enabled)
+		deferred = std::make_unique<ScanlineRenderer>(pool);
+}
+
+void nes2c02::logRegisters()
+{
+	if (deferred->logging())
+		deferred->logRegisters(ScanlineRenderer::position(scanline, cycle), { vram_addr.reg, tram_addr.reg, fine_x, control_reg.reg, mask_reg.reg });
+}
+
+void nes2c02::logMemory(uint16_t addr, uint8_t data)
+{
+	//pattern writes are logged as the byte that is there now, chr rom keeps its own
+	addr &= 0x3FFF;
+	if (deferred->logging())
+		deferred->logMemory(ScanlineRenderer::position(scanline, cycle), addr, addr < 0x2000 ? ppuRead(addr) : data);
+}
+
+void nes2c02::deferredDot()
+{
+	if (scanline == -1 && cycle == 0 && renderEnabled)
+	{
+		//everything the frame is drawn from, later changes come from the log
+		ScanlineRenderer::Frame& frame = deferred->begin();
+		for (uint16_t addr = 0; addr < 0x2000; addr++)
+			frame.pattern[addr] = ppuRead(addr);
+		std::memcpy(frame.nameTable, nameTable, sizeof(nameTable));
+		std::memcpy(frame.palette, paletteTable, sizeof(paletteTable));
+		frame.vertical = cartridge->mirror == Cartridge::Mirror::VERTICAL;
+	}
+
+	if (!deferred->logging())
+		return;
+
+	if (cycle == 321 && scanline < 239)
+		deferred->frame().lineStart[scanline + 1] = { vram_addr.reg, tram_addr.reg, fine_x, control_reg.reg, mask_reg.reg };
+	else if (scanline == 240 && cycle == 0)
+		deferred->submit();
+}
+
+void nes2c02::saveState(StateWriter& writer) const
+{
+	State state = {
+		mask_reg.reg, status_reg.reg, control_reg.reg,
+		fine_x, addr_latch, ppu_data_buffer,
+		vram_addr.reg, tram_addr.reg,
+		scanline, cycle,
+		bg_next_id, bg_next_attrib, bg_next_pattern_low, bg_next_pattern_high,
+		bg_shifter_pattern_low, bg_shifter_pattern_high, bg_shifter_attrib_low, bg_shifter_attrib_high,
+		oam_addr,
+		nmi, frame_complete
+	};
+	writer.write("PPU ", 1, state);
+	writer.write("VRAM", 1, nameTable);
+	writer.write("PAL ", 1, paletteTable);
+	writer.write("OAM ", 1, oam);
+	if (patternTable)
+		writer.writeChunk("PTRN", 1, patternTable.get(), 2 * 4096);
+}
+
+bool nes2c02::loadState(const StateReader& reader)
+{
+	State state;
+	if (!reader.read("PPU ", 1, state))
+		return false;
+	//run-ahead and rewind load a state every frame, only what differs from before is marked changed
+	uint8_t oldNameTable[2][1024];
+	uint8_t oldPalette[32];
+	std::memcpy(oldNameTable, nameTable, sizeof(nameTable));
+	std::memcpy(oldPalette, paletteTable, sizeof(paletteTable));
+	if (!reader.read("VRAM", 1, nameTable) || !reader.read("PAL ", 1, paletteTable) || !reader.read("OAM ", 1, oam))
+	{
+		dirty.markAll();
+		return false;
+	}
+	//only present when the saving machine had allocated its fallback pattern tables
+	if (reader.contains("PTRN"))
+	{
+		for (uint64_t& tiles : dirty.tiles)
+			tiles = ~0ull;
+		if (!reader.readChunk("PTRN", 1, fallbackPatternTable(), 2 * 4096))
+			return false;
+	}
+
+	for (int table = 0; table < 2; table++)
+	{
+		for (int row = 0; row < 30; row++)
+		{
+			if (std::memcmp(&oldNameTable[table][row * 32], &nameTable[table][row * 32], 32) != 0)
+				dirty.nameRows[table] |= 1u << row;
+		}
+		for (int i = 0; i < 64; i++)
+		{
+			if (oldNameTable[table][960 + i] != nameTable[table][960 + i])
+				dirty.attributes[table] |= 1ull << i;
+		}
+	}
+	for (int i = 0; i < 32; i++)
+	{
+		if (oldPalette[i] != paletteTable[i])
+			dirty.palette |= 1u << i;
+	}
+
+	mask_reg.reg = state.mask_reg;
+	status_reg.reg = state.status_reg;
+	control_reg.reg = state.control_reg;
+	fine_x = state.fine_x;
+	addr_latch = state.addr_latch;
+	ppu_data_buffer = state.ppu_data_buffer;
+	vram_addr.reg = state.vram_addr;
+	tram_addr.reg = state.tram_addr;
+	scanline = state.scanline;
+	cycle = state.cycle;
+	bg_next_id = state.bg_next_id;
+	bg_next_attrib = state.bg_next_attrib;
+	bg_next_pattern_low = state.bg_next_pattern_low;
+	bg_next_pattern_high = state.bg_next_pattern_high;
+	bg_shifter_pattern_low = state.bg_shifter_pattern_low;
+	bg_shifter_pattern_high = state.bg_shifter_pattern_high;
+	bg_shifter_attrib_low = state.bg_shifter_attrib_low;
+	bg_shifter_attrib_high = state.bg_shifter_attrib_high;
+	oam_addr = state.oam_addr;
+	nmi = state.nmi;
+	frame_complete = state.frame_complete;
+	//the log of a frame in progress belongs to the machine before the load
+	if (deferred)
+		deferred->abort();
+	return true;
 }
 
 void nes2c02::clock()
@@ -340,19 +545,27 @@ void nes2c02::clock()
 	{
 		if (mask_reg.bg_show)
 		{
-			bg_shifter_attrib_high <<= 1;
-			bg_shifter_attrib_low <<= 1;
+			bg_shifter_pattern_high <<= 1;
+			bg_shifter_pattern_low <<= 1;
 			bg_shifter_attrib_high <<= 1;
 			bg_shifter_attrib_low <<= 1;
 		}
 	};
 
+	if (deferred && (cycle == 0 || cycle == 321))
+		deferredDot();
+
 	if (scanline >= -1 && scanline < 240)
 	{
 		if (scanline == 0 && cycle == 0)  cycle = 1;
 		if (scanline == -1 && cycle == 1) status_reg.vblank = 0;
 
-		if ((cycle >= 2 && cycle < 258) || (cycle >= 321 && cycle < 338))
+		//the deferred renderer does the fetches itself, only the scroll has to move here
+		if (deferred && ((cycle >= 2 && cycle < 258) || (cycle >= 321 && cycle < 338)))
+		{
+			if ((cycle - 1) % 8 == 7) IncScrollX();
+		}
+		else if ((cycle >= 2 && cycle < 258) || (cycle >= 321 && cycle < 338))
 		{
 			UpdateBGShifters();
 			switch ((cycle - 1) % 8)
@@ -390,7 +603,7 @@ void nes2c02::clock()
 			ResetToTempAddressX();
 		}
 
-		if (cycle == 338 || cycle == 340) bg_next_id = ppuRead(0x2000 | (vram_addr.reg & 0x0FFF));
+		if (!deferred && (cycle == 338 || cycle == 340)) bg_next_id = ppuRead(0x2000 | (vram_addr.reg & 0x0FFF));
 
 		if (scanline == -1 && cycle >= 280 && cycle < 305) ResetToTempAddressY();
 	}
@@ -409,7 +622,7 @@ void nes2c02::clock()
 	uint8_t bg_pixel = 0x00;
 	uint8_t bg_palette = 0x00;
 
-	if (mask_reg.bg_show)
+	if (mask_reg.bg_show && !deferred)
 	{
 		uint16_t shift_select_bit = 0x8000 >> fine_x;
 
@@ -423,13 +636,11 @@ void nes2c02::clock()
 	}
 
 	//Draw to buffer pixel by pixel x:(cycle -1), y:scanline;
-	if ((cycle >= 1) && (cycle < 257) && (scanline >= 0) && (scanline < 240))
+	if (renderEnabled && !deferred && (cycle >= 1) && (cycle < 257) && (scanline >= 0) && (scanline < 240))
 	{
-		// TODO!!
-		// size_t i = (cycle - 1) / 4;
-		// size_t j = scanline / 4;
-		// screenBuffer.setPixel(cycle - 1, scanline, sf::Color(patternTable[0][j*32+i], 0, 0, 255));
-		screenBuffer.setPixel(cycle - 1, scanline, getColorFromPalette(bg_palette, bg_pixel));
+		if (!frameBuffer)
+			frameBuffer = std::make_unique<uint8_t[]>(SCREEN_WIDTH * SCREEN_HEIGHT);
+		frameBuffer[scanline * SCREEN_WIDTH + (cycle - 1)] = getColorFromPalette(bg_palette, bg_pixel);
 	}
 
 	cycle++;
@@ -445,6 +656,17 @@ void nes2c02::clock()
 	}
 }
 
+void nes2c02::powerOn()
+{
+	std::fill_n(&nameTable[0][0], 2 * 1024, 128);
+	std::fill_n(paletteTable, 32, 0);
+	std::fill_n(oam, 256, 0);
+	if (patternTable)
+		std::fill_n(patternTable.get(), 2 * 4096, 128);
+	dirty.markAll();
+	reset();
+}
+
 void nes2c02::reset()
 {
 	fine_x = 0x00;
@@ -455,6 +677,7 @@ void nes2c02::reset()
 	control_reg.reg = 0x00;
 	vram_addr.reg = 0x0000;
 	tram_addr.reg = 0x0000;
+	oam_addr = 0x00;
 	scanline = 0;
 	cycle = 0;
 	bg_next_attrib = 0;
@@ -465,4 +688,6 @@ void nes2c02::reset()
 	bg_shifter_attrib_low = 0x0000;
 	bg_shifter_pattern_high = 0x0000;
 	bg_shifter_pattern_low = 0x0000;
+	if (deferred)
+		deferred->abort();
 }
\ No newline at end of file
@@ -1,20 +1,36 @@
 #pragma once
 
 #include <memory>
-#include "SFML/Graphics.hpp"
+#include <cinttypes>
 
 class Cartridge;
+class ScanlineRenderer;
+class ThreadPool;
+class StateWriter;
+class StateReader;
 
 class nes2c02
 {
-private:
-	std::shared_ptr<Cartridge> cartridge;
+public:
+	static constexpr int SCREEN_WIDTH = 256;
+	static constexpr int SCREEN_HEIGHT = 240;
+
+	//what changed in ppu memory since the last takeDirty(), one bit per region, for viewers that only
+	//decode what changed. Name tables are per physical table: 30 tile rows and 64 attribute bytes.
+	struct VramDirty
+	{
+		uint32_t nameRows[2];
+		uint64_t attributes[2];
+		//chr tiles of $0000-$1FFF, 16 bytes each
+		uint64_t tiles[8];
+		uint32_t palette;
 
-	//Image buffer
-	sf::Image screenBuffer;
+		void merge(const VramDirty& other);
+		void markAll();
+	};
 
-	//PPU Palette
-	uint8_t ppuPalette[0x40][4] = {
+	//PPU Palette, shared by every instance
+	static constexpr uint8_t ppuPalette[0x40][4] = {
 		 {84, 84, 84, 255}
 		,{0, 30, 116, 255}
 		,{8, 16, 144, 255}
@@ -83,13 +99,8 @@ private:
 		,{0, 0, 0, 255}
 		,{0, 0, 0, 255}
 	};
-	
-
-	//Tables
-	uint8_t nameTable[2][1024];
-	uint8_t patternTable[2][4096];
-	uint8_t paletteTable[32];
 
+private:
 	//Registers
 	union PPUMASK
 	{
@@ -175,10 +186,40 @@ private:
 	uint16_t bg_shifter_attrib_low = 0x00;
 	uint16_t bg_shifter_attrib_high = 0x00;
 
-	sf::Color getColorFromPalette(uint8_t palette, uint8_t pixel);
+	uint8_t oam_addr = 0x00;
+
+public:
+	bool nmi = false;
+	bool frame_complete = false;
+
+private:
+	//Tables, kept next to the registers so the hot state is one block
+	uint8_t nameTable[2][1024];
+	uint8_t paletteTable[32];
+	uint8_t oam[256];
+
+	//Cold pointers and optional buffers
+	std::shared_ptr<Cartridge> cartridge;
+	//only backs $0000-$1FFF when the cartridge does not map it, allocated on first use
+	std::unique_ptr<uint8_t[]> patternTable;
+	//one palette index per pixel, allocated on the first rendered frame
+	std::unique_ptr<uint8_t[]> frameBuffer;
+	bool renderEnabled = true;
+	VramDirty dirty = {};
+	//set while the frame is logged for the deferred renderer instead of drawn dot by dot
+	std::unique_ptr<ScanlineRenderer> deferred;
+
+	uint8_t getColorFromPalette(uint8_t palette, uint8_t pixel);
+	uint8_t* fallbackPatternTable();
+	//frame start, line starts and the end of the visible lines for the deferred renderer
+	void deferredDot();
+	//scroll registers after a cpu access, or a ppu memory write, while a frame is logged
+	void logRegisters();
+	void logMemory(uint16_t addr, uint8_t data);
 
 public:
 	nes2c02();
+	~nes2c02();
 
 	void insertCartridge(std::shared_ptr<Cartridge> cartridge);
 
@@ -191,11 +232,48 @@ public:
 	uint8_t ppuRead(uint16_t addr);
 
 	void clock();
+	//reset() keeps the name tables, palette and oam, this also clears them
+	void powerOn();
 	void reset();
 
-	sf::Image& getScreenBuffer();
+	//dots run since the start of the pre-render line, the skipped dot 0 of line 0 doesn't count
+	uint32_t frameDot() const;
+	bool nmiEnabled() const { return control_reg.generate_nmi; }
 
-	bool nmi = false;
-	bool frame_complete = false;
+	VramDirty takeDirty();
+	//chr ram is loaded with the cartridge, past the ppu, so a state load marks it all changed
+	void chrReplaced();
+	//ppu memory as the background is drawn from it: $0000-$1FFF as mapped now, the two physical
+	//name tables and the palette without greyscale
+	void readVram(uint8_t* pattern, uint8_t (*nameTables)[1024], uint8_t* palette);
+	bool verticalMirroring() const;
+	uint8_t backgroundPatternTable() const { return control_reg.bg_patterntable; }
+
+	//palette indices into ppuPalette, nullptr until a frame has been rendered
+	const uint8_t* getFrameBuffer() const;
+
+	//when disabled the ppu keeps its timing but skips pixel output and never allocates a framebuffer
+	void setRendering(bool enabled);
+	//Draws each frame's visible lines at once after the last of them instead of dot by dot, in
+	//parallel on pool if there is one. The pixels are the same, the frame may still be rendering
+	//when clock() returns and getFrameBuffer() waits for it. Sprites are not drawn in either mode.
+	void setDeferredRendering(bool enabled, ThreadPool* pool = nullptr);
+
+	//the framebuffer is not part of the state, the next rendered frame rebuilds it
+	void saveState(StateWriter& writer) const;
+	bool loadState(const StateReader& reader);
+
+private:
+	struct State
+	{
+		uint8_t mask_reg, status_reg, control_reg;
+		uint8_t fine_x, addr_latch, ppu_data_buffer;
+		uint16_t vram_addr, tram_addr;
+		int16_t scanline, cycle;
+		uint8_t bg_next_id, bg_next_attrib, bg_next_pattern_low, bg_next_pattern_high;
+		uint16_t bg_shifter_pattern_low, bg_shifter_pattern_high, bg_shifter_attrib_low, bg_shifter_attrib_high;
+		uint8_t oam_addr;
+		bool nmi, frame_complete;
+	};
 };
 
@@ -1,20 +1,26 @@
 #include "nes6502.h"
 #include "Bus.h"
-#include "Common.h"
+#include "SaveState.h"
 
-#include <sstream>
+#include <array>
+#include <utility>
 
-uint8_t nes6502::fetch()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::fetch()
 {
-	if (instructions[opcode].addrmode != &nes6502::IMP)
+	if (instructions[opcode].addrmode != &nes6502Core::IMP && instructions[opcode].addrmode != &nes6502Core::ACC)
 		fetched = read(addr_abs);
 	return fetched;
 }
 
-void nes6502::reset()
+template <CpuAccuracy accuracy>
+void nes6502Core<accuracy>::reset()
 {
 	addr_abs = 0xFFFC;
-	pc = (read(addr_abs + 1) << 8) | read(addr_abs);
+	//low byte first, like every two-byte read below
+	uint16_t lo = bus->cpuRead(addr_abs);
+	uint16_t hi = bus->cpuRead(addr_abs + 1);
+	pc = (hi << 8) | lo;
 	// pc = 0xc000; // TODO: delete it
 
 	reg_a = 0;
@@ -30,10 +36,37 @@ void nes6502::reset()
 	cycles = 8;
 }
 
-void nes6502::clock()
+template <CpuAccuracy accuracy>
+void nes6502Core<accuracy>::clock()
 {
+	if constexpr (accuracy == CpuAccuracy::CycleExact)
+	{
+		//the whole instruction runs here, every bus access advances the rest of the machine
+		//by one cpu cycle so one call covers all of its cycles
+		for (; cycles > 0; cycles--)
+			bus->cpuTick();
+
+		busCycles = 0;
+		uint16_t start = pc;
+		opcode = read(pc++);
+
+		cycles = instructions[opcode].cycle;
+
+		uint8_t cycle1 = (this->*instructions[opcode].addrmode)();
+		uint8_t cycle2 = (this->*instructions[opcode].opcode)();
+		cycles += cycle1 & cycle2;
+		profile(start);
+
+		//internal cycles that have no bus access of their own
+		for (; busCycles < cycles; busCycles++)
+			bus->cpuTick();
+		cycles = 0;
+		return;
+	}
+
 	if (cycles == 0)
 	{
+		uint16_t start = pc;
 		opcode = read(pc++);
 
 		cycles = instructions[opcode].cycle;
@@ -41,14 +74,27 @@ void nes6502::clock()
 		uint8_t cycle1 = (this->*instructions[opcode].addrmode)();
 		uint8_t cycle2 = (this->*instructions[opcode].opcode)();
 		cycles += cycle1 & cycle2;
+		profile(start);
 	}
 	cycles--;
 }
 
-void nes6502::irq()
+template <CpuAccuracy accuracy>
+void nes6502Core<accuracy>::profile([[maybe_unused]] uint16_t start)
 {
-	if (getFlag(I))
+#ifdef NES_PROFILE
+	if (Profiler* profiler = bus->getProfiler())
+		profiler->instruction(start, opcode, cycles);
+#endif
+}
+
+template <CpuAccuracy accuracy>
+void nes6502Core<accuracy>::irq()
+{
+	if (getFlag(I) == 0)
 	{
+		dummyRead(pc);
+		dummyRead(pc);
 		write(0x0100 + sp, (pc >> 8) & 0x00FF);
 		sp--;
 		write(0x0100 + sp, pc & 0x00FF);
@@ -60,14 +106,19 @@ void nes6502::irq()
 		write(0x0100 + sp, status_reg);
 		sp--;
 
-		pc = (uint16_t)read(0xFFFE) | ((uint16_t)read(0xFFFF) << 8);
+		uint16_t lo = read(0xFFFE);
+		uint16_t hi = read(0xFFFF);
+		pc = (hi << 8) | lo;
 
-		cycles = 7;
+		cycles = accuracy == CpuAccuracy::CycleExact ? 0 : 7;
 	}
 }
 
-void nes6502::nmi()
+template <CpuAccuracy accuracy>
+void nes6502Core<accuracy>::nmi()
 {
+	dummyRead(pc);
+	dummyRead(pc);
 	write(0x0100 + sp, (pc >> 8) & 0x00FF);
 	sp--;
 	write(0x0100 + sp, pc & 0x00FF);
@@ -79,27 +130,68 @@ void nes6502::nmi()
 	write(0x0100 + sp, status_reg);
 	sp--;
 
-	pc = (uint16_t)read(0xFFFA) | ((uint16_t)read(0xFFFB) << 8);
+	uint16_t lo = read(0xFFFA);
+	uint16_t hi = read(0xFFFB);
+	pc = (hi << 8) | lo;
 
-	cycles = 8;
+	cycles = accuracy == CpuAccuracy::CycleExact ? 0 : 8;
 }
 
-uint8_t nes6502::read(uint16_t addr) const
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::read(uint16_t addr)
 {
-	return bus->cpuRead(addr);
+	uint8_t data = bus->cpuRead(addr);
+	if constexpr (accuracy == CpuAccuracy::CycleExact)
+	{
+		bus->cpuTick();
+		busCycles++;
+	}
+	return data;
 }
 
-void nes6502::write(uint16_t addr, uint8_t data) const
+template <CpuAccuracy accuracy>
+void nes6502Core<accuracy>::write(uint16_t addr, uint8_t data)
 {
 	bus->cpuWrite(addr, data);
+	if constexpr (accuracy == CpuAccuracy::CycleExact)
+	{
+		bus->cpuTick();
+		busCycles++;
+	}
+}
+
+template <CpuAccuracy accuracy>
+void nes6502Core<accuracy>::dummyRead(uint16_t addr)
+{
+	if constexpr (accuracy == CpuAccuracy::CycleExact)
+		read(addr);
+}
+
+template <CpuAccuracy accuracy>
+void nes6502Core<accuracy>::dummyWrite(uint16_t addr, uint8_t data)
+{
+	if constexpr (accuracy == CpuAccuracy::CycleExact)
+		write(addr, data);
+}
+
+//stores and read-modify-writes always spend the extra indexed cycle, reads only on a page cross
+template <CpuAccuracy accuracy>
+bool nes6502Core<accuracy>::writesOperand() const
+{
+	auto op = instructions[opcode].opcode;
+	return op == &nes6502Core::STA || op == &nes6502Core::STX || op == &nes6502Core::STY
+		|| op == &nes6502Core::ASL || op == &nes6502Core::LSR || op == &nes6502Core::ROL
+		|| op == &nes6502Core::ROR || op == &nes6502Core::INC || op == &nes6502Core::DEC;
 }
 
-uint8_t nes6502::getFlag(Flags flagName)
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::getFlag(Flags flagName)
 {
 	return (status_reg & flagName) > 0;
 }
 
-void nes6502::setFlag(Flags flagName, uint8_t data)
+template <CpuAccuracy accuracy>
+void nes6502Core<accuracy>::setFlag(Flags flagName, uint8_t data)
 {
 	if (data)
 		status_reg |= flagName;
@@ -107,149 +199,159 @@ void nes6502::setFlag(Flags flagName, uint8_t data)
 		status_reg &= ~flagName;
 }
 
-std::map<uint16_t, std::string> nes6502::dissamble(uint16_t start, uint16_t end) const
+template <CpuAccuracy accuracy>
+AddressMode nes6502Core<accuracy>::addressMode(uint8_t opcode)
 {
-	uint16_t pos = start;
-
-	auto next = [&]() -> std::string {
-		return hex(read(pos++));
-	};
-
-	std::map<uint16_t, std::string> dump;
-
-	while (pos < end - 1)
+	//the table holds member pointers, they are turned into modes once instead of compared on every call
+	static const auto modes = []
 	{
-		std::stringstream ss;
-		uint16_t p = pos;
-		ss << "0x" << hex(pos) << ": ";
-
-		uint8_t opcode = read(pos++);
-		Instruction inst = instructions[opcode];
-
-		ss << inst.name << "[" << hex(opcode) << "] ";
-
-		if (inst.addrmode == &nes6502::IMM)
-		{
-			ss << "#$" << next();
-		}
-		else if (inst.addrmode == &nes6502::IMP)
-		{
-		}
-		else if (inst.addrmode == &nes6502::ZP0)
-		{
-			ss << "*" << next();
-		}
-		else if (inst.addrmode == &nes6502::ZPX)
-		{
-			ss << "*" << next() << ", X";
-		}
-		else if (inst.addrmode == &nes6502::ZPY)
-		{
-			ss << "*" << next() << ", Y";
-		}
-		else if (inst.addrmode == &nes6502::ABS)
+		const std::pair<uint8_t(nes6502Core::*)(void), AddressMode> known[] =
 		{
-			auto lo = next();
-			ss << next() << lo;
-		}
-		else if (inst.addrmode == &nes6502::ABX)
-		{
-			auto lo = next();
-			ss << next() << lo << ", X";
-		}
-		else if (inst.addrmode == &nes6502::ABY)
+			{ &nes6502Core::IMP, AddressMode::IMP }, { &nes6502Core::ACC, AddressMode::ACC }, { &nes6502Core::IMM, AddressMode::IMM },
+			{ &nes6502Core::ZP0, AddressMode::ZP0 }, { &nes6502Core::ZPX, AddressMode::ZPX }, { &nes6502Core::ZPY, AddressMode::ZPY },
+			{ &nes6502Core::REL, AddressMode::REL }, { &nes6502Core::ABS, AddressMode::ABS }, { &nes6502Core::ABX, AddressMode::ABX },
+			{ &nes6502Core::ABY, AddressMode::ABY }, { &nes6502Core::IND, AddressMode::IND }, { &nes6502Core::IZX, AddressMode::IZX },
+			{ &nes6502Core::IZY, AddressMode::IZY }
+		};
+
+		std::array<AddressMode, 256> table{};
+		for (int i = 0; i < 256; i++)
 		{
-			auto lo = next();
-			ss << next() << lo << ", Y";
-		}
-		else if (inst.addrmode == &nes6502::ACC)
-		{
-			ss << "A";
-		}
-		else if (inst.addrmode == &nes6502::REL)
-		{
-			ss << next();
-		}
-		else if (inst.addrmode == &nes6502::IND)
-		{
-			auto lo = next();
-			ss << "(" << next() << lo << ")";
-		}
-		else if (inst.addrmode == &nes6502::IZX)
-		{
-			ss << "(" << next() << ", X)";
-		}
-		else if (inst.addrmode == &nes6502::IZY)
-		{
-			ss << "(" << next() << "), Y";
+			for (const auto& mode : known)
+			{
+				if (instructions[i].addrmode == mode.first)
+					table[i] = mode.second;
+			}
 		}
+		return table;
+	}();
 
-		dump.insert({ p, ss.str() });
-	}
+	return modes[opcode];
+}
 
-	return dump;
+template <CpuAccuracy accuracy>
+void nes6502Core<accuracy>::saveState(StateWriter& writer) const
+{
+	State state = { pc, addr_abs, addr_rel, reg_a, reg_x, reg_y, sp, status_reg, cycles, fetched, opcode, busCycles };
+	writer.write("CPU ", 1, state);
+}
+
+template <CpuAccuracy accuracy>
+bool nes6502Core<accuracy>::loadState(const StateReader& reader)
+{
+	State state;
+	if (!reader.read("CPU ", 1, state))
+		return false;
+
+	pc = state.pc;
+	addr_abs = state.addr_abs;
+	addr_rel = state.addr_rel;
+	reg_a = state.reg_a;
+	reg_x = state.reg_x;
+	reg_y = state.reg_y;
+	sp = state.sp;
+	status_reg = state.status_reg;
+	cycles = state.cycles;
+	fetched = state.fetched;
+	opcode = state.opcode;
+	busCycles = state.busCycles;
+	return true;
 }
 
-uint8_t nes6502::IMM()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::IMM()
 {
 	addr_abs = pc++;
 	return 0;
 }
 
-uint8_t nes6502::IMP()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::IMP()
 {
+	dummyRead(pc);
 	return 0;
 }
 
-uint8_t nes6502::ZP0()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::ZP0()
 {
 	addr_abs = read(pc++) & 0xFF;
 	return 0;
 }
 
-uint8_t nes6502::ZPX()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::ZPX()
 {
-	addr_abs = (read(pc++) + reg_x) & 0xFF;
+	uint8_t arg = read(pc++);
+	dummyRead(arg);
+	addr_abs = (arg + reg_x) & 0xFF;
 	return 0;
 }
 
-uint8_t nes6502::ZPY()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::ZPY()
 {
-	addr_abs = (read(pc++) + reg_y) & 0xFF;
+	uint8_t arg = read(pc++);
+	dummyRead(arg);
+	addr_abs = (arg + reg_y) & 0xFF;
 	return 0;
 }
 
-uint8_t nes6502::ABS()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::ABS()
 {
 	uint16_t lo = read(pc++);
+	//jsr pushes its return address between the two operand reads, it reads the high byte itself
+	if (opcode == 0x20)
+	{
+		addr_abs = lo;
+		return 0;
+	}
 	uint16_t hi = read(pc++);
 	addr_abs = (hi << 8) | lo;
 	return 0;
 }
 
-uint8_t nes6502::ABX()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::ABX()
 {
 	uint16_t lo = read(pc++);
 	uint16_t hi = read(pc++);
 	addr_abs = ((hi << 8) | lo) + reg_x;
-	return (hi << 8) != (addr_abs & 0xFF00); // Page wrapping
+	bool crossed = (hi << 8) != (addr_abs & 0xFF00); // Page wrapping
+
+	if constexpr (accuracy == CpuAccuracy::CycleExact)
+		if (crossed || writesOperand())
+			read((hi << 8) | (addr_abs & 0x00FF));
+
+	return crossed;
 }
 
-uint8_t nes6502::ABY()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::ABY()
 {
 	uint16_t lo = read(pc++);
 	uint16_t hi = read(pc++);
 	addr_abs = ((hi << 8) | lo) + reg_y;
-	return (hi << 8) != (addr_abs & 0xFF00); // Page wrapping
+	bool crossed = (hi << 8) != (addr_abs & 0xFF00); // Page wrapping
+
+	if constexpr (accuracy == CpuAccuracy::CycleExact)
+		if (crossed || writesOperand())
+			read((hi << 8) | (addr_abs & 0x00FF));
+
+	return crossed;
 }
 
-uint8_t nes6502::ACC()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::ACC()
 {
+	dummyRead(pc);
 	fetched = reg_a;
 	return 0;
 }
 
-uint8_t nes6502::REL()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::REL()
 {
 	addr_rel = read(pc++);
 	if (addr_rel & 0x80)
@@ -257,37 +359,49 @@ uint8_t nes6502::REL()
 	return 0;
 }
 
-uint8_t nes6502::IND()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::IND()
 {
 	uint8_t lo = read(pc++);
 	uint8_t hi = read(pc++);
 	uint16_t ptr = (hi << 8) | lo;
-	if (lo == 0xFF)
-		addr_abs = (read((ptr + 1) & 0xFF) << 8) | read(ptr);
-	else
-		addr_abs = read(ptr + 1) << 8 | read(ptr);
+	//one read per statement, so the low byte is on the bus first
+	uint8_t target_lo = read(ptr);
+	//the pointer's high byte does not carry into the next page
+	uint8_t target_hi = read(lo == 0xFF ? ptr & 0xFF00 : ptr + 1);
+	addr_abs = (target_hi << 8) | target_lo;
 	return 0;
 }
 
-uint8_t nes6502::IZX()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::IZX()
 {
 	uint8_t arg = read(pc++);
+	dummyRead(arg);
 	uint8_t ptr_lo = read((arg + reg_x) & 0xFF);
 	uint8_t ptr_hi = read((arg + reg_x + 1) & 0xff);
 	addr_abs = ptr_hi << 8 | ptr_lo;
 	return 0;
 }
 
-uint8_t nes6502::IZY()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::IZY()
 {
 	uint8_t arg = read(pc++);
 	uint8_t lo = read(arg);
 	uint8_t hi = read((arg + 1) & 0xFF);
 	addr_abs = (hi << 8 | lo) + reg_y;
-	return (hi << 8) != (addr_abs & 0xFF00); // Page wrapping
+	bool crossed = (hi << 8) != (addr_abs & 0xFF00); // Page wrapping
+
+	if constexpr (accuracy == CpuAccuracy::CycleExact)
+		if (crossed || writesOperand())
+			read((hi << 8) | (addr_abs & 0x00FF));
+
+	return crossed;
 }
 
-uint8_t nes6502::ADC()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::ADC()
 {
 	fetch();
 	uint16_t val = reg_a + fetched + getFlag(C);
@@ -308,7 +422,8 @@ uint8_t nes6502::ADC()
 	return 1;
 }
 
-uint8_t nes6502::AND()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::AND()
 {
 	fetch();
 
@@ -320,37 +435,46 @@ uint8_t nes6502::AND()
 	return 1;
 }
 
-uint8_t nes6502::ASL()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::ASL()
 {
 	fetch();
 	uint16_t temp = (uint16_t)fetched << 1;
 	setFlag(C, (temp & 0xFF00) > 0);
 	setFlag(Z, (temp & 0x00FF) == 0);
 	setFlag(N, temp & 0x0080);
-	if (instructions[opcode].addrmode == &nes6502::IMP) reg_a = temp & 0x00FF;
-	else write(addr_abs, temp & 0x00FF);
+	if (instructions[opcode].addrmode == &nes6502Core::ACC) reg_a = temp & 0x00FF;
+	else
+	{
+		dummyWrite(addr_abs, fetched);
+		write(addr_abs, temp & 0x00FF);
+	}
 	return 0;
 }
 
-uint8_t nes6502::BCC()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::BCC()
 {
 	branch(C, 0);
 	return 0;
 }
 
-uint8_t nes6502::BCS()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::BCS()
 {
 	branch(C, 1);
 	return 0;
 }
 
-uint8_t nes6502::BEQ()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::BEQ()
 {
 	branch(Z, 1);
 	return 0;
 }
 
-uint8_t nes6502::BIT()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::BIT()
 {
 	fetch();
 	uint16_t temp = reg_a & fetched;
@@ -360,26 +484,30 @@ uint8_t nes6502::BIT()
 	return 0;
 }
 
-uint8_t nes6502::BMI()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::BMI()
 {
 	branch(N, 1);
 	return 0;
 }
 
-uint8_t nes6502::BNE()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::BNE()
 {
 	branch(Z, 0);
 	return 0;
 }
 
-uint8_t nes6502::BPL()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::BPL()
 {
 	branch(N, 0);
 
 	return 0;
 }
 
-uint8_t nes6502::BRK()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::BRK()
 {
 	pc++;
 
@@ -394,48 +522,57 @@ uint8_t nes6502::BRK()
 	sp--;
 	setFlag(B, 0);
 
-	pc = (uint16_t)read(0xFFFE) | ((uint16_t)read(0xFFFF) << 8);
+	uint16_t lo = read(0xFFFE);
+	uint16_t hi = read(0xFFFF);
+	pc = (hi << 8) | lo;
 
 	return 0;
 }
 
-uint8_t nes6502::BVC()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::BVC()
 {
 	branch(V, 0);
 	return 0;
 }
 
-uint8_t nes6502::BVS()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::BVS()
 {
 	branch(V, 1);
 	return 0;
 }
 
-uint8_t nes6502::CLC()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::CLC()
 {
 	setFlag(C, 0);
 	return 0;
 }
 
-uint8_t nes6502::CLD()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::CLD()
 {
 	setFlag(D, 0);
 	return 0;
 }
 
-uint8_t nes6502::CLI()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::CLI()
 {
 	setFlag(I, 0);
 	return 0;
 }
 
-uint8_t nes6502::CLV()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::CLV()
 {
 	setFlag(V, 0);
 	return 0;
 }
 
-uint8_t nes6502::CMP()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::CMP()
 {
 	fetch();
 	uint16_t val = (uint16_t)reg_a - (uint16_t)fetched;
@@ -447,7 +584,8 @@ uint8_t nes6502::CMP()
 	return 1;
 }
 
-uint8_t nes6502::CPX()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::CPX()
 {
 	fetch();
 	uint16_t temp = (uint16_t)reg_x - (uint16_t)fetched;
@@ -457,7 +595,8 @@ uint8_t nes6502::CPX()
 	return 0;
 }
 
-uint8_t nes6502::CPY()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::CPY()
 {
 	fetch();
 	uint16_t temp = (uint16_t)reg_y - (uint16_t)fetched;
@@ -467,10 +606,12 @@ uint8_t nes6502::CPY()
 	return 0;
 }
 
-uint8_t nes6502::DEC()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::DEC()
 {
 	fetch();
 	uint8_t val = fetched - 1;
+	dummyWrite(addr_abs, fetched);
 	write(addr_abs, val);
 
 	setFlag(Z, val == 0);
@@ -479,7 +620,8 @@ uint8_t nes6502::DEC()
 	return 0;
 }
 
-uint8_t nes6502::DEX()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::DEX()
 {
 	reg_x--;
 
@@ -489,7 +631,8 @@ uint8_t nes6502::DEX()
 	return 0;
 }
 
-uint8_t nes6502::DEY()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::DEY()
 {
 	reg_y--;
 	setFlag(Z, reg_y == 0x00);
@@ -497,7 +640,8 @@ uint8_t nes6502::DEY()
 	return 0;
 }
 
-uint8_t nes6502::EOR()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::EOR()
 {
 	fetch();
 	reg_a = reg_a ^ fetched;
@@ -506,10 +650,12 @@ uint8_t nes6502::EOR()
 	return 1;
 }
 
-uint8_t nes6502::INC()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::INC()
 {
 	fetch();
 	uint8_t val = fetched + 1;
+	dummyWrite(addr_abs, fetched);
 	write(addr_abs, val);
 
 	setFlag(Z, val == 0);
@@ -518,7 +664,8 @@ uint8_t nes6502::INC()
 	return 0;
 }
 
-uint8_t nes6502::INX()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::INX()
 {
 	reg_x++;
 
@@ -528,7 +675,8 @@ uint8_t nes6502::INX()
 	return 0;
 }
 
-uint8_t nes6502::INY()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::INY()
 {
 	reg_y++;
 	setFlag(Z, reg_y == 0x00);
@@ -536,23 +684,29 @@ uint8_t nes6502::INY()
 	return 0;
 }
 
-uint8_t nes6502::JMP()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::JMP()
 {
 	pc = addr_abs;
 	return 0;
 }
 
-uint8_t nes6502::JSR()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::JSR()
 {
-	uint16_t pushed = pc - 1;
-	write(0x0100 + sp--, (pushed >> 8) & 0xFF);
-	write(0x0100 + sp--, pushed & 0xFF);
+	//pc is on the high operand byte, which is the return address minus one jsr pushes
+	dummyRead(0x0100 + sp);
+	write(0x0100 + sp--, (pc >> 8) & 0xFF);
+	write(0x0100 + sp--, pc & 0xFF);
+	uint16_t hi = read(pc);
+	addr_abs |= hi << 8;
 	pc = addr_abs;
 
 	return 0;
 }
 
-uint8_t nes6502::LDA()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::LDA()
 {
  	fetch();
 	reg_a = fetched;
@@ -562,7 +716,8 @@ uint8_t nes6502::LDA()
 	return 1;
 }
 
-uint8_t nes6502::LDX()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::LDX()
 {
 	fetch();
 	reg_x = fetched;
@@ -571,7 +726,8 @@ uint8_t nes6502::LDX()
 	return 1;
 }
 
-uint8_t nes6502::LDY()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::LDY()
 {
 	fetch();
 	reg_y = fetched;
@@ -580,14 +736,18 @@ uint8_t nes6502::LDY()
 	return 1;
 }
 
-uint8_t nes6502::LSR()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::LSR()
 {
 	fetch();
 	uint8_t temp = fetched >> 1;
-	if (instructions[opcode].addrmode == &nes6502::ACC)
+	if (instructions[opcode].addrmode == &nes6502Core::ACC)
 		reg_a = temp;
 	else
+	{
+		dummyWrite(addr_abs, fetched);
 		write(addr_abs, temp);
+	}
 
 	setFlag(C, fetched & 0x0001);
 	setFlag(Z, (temp & 0x00FF) == 0x0000);
@@ -596,8 +756,11 @@ uint8_t nes6502::LSR()
 	return 0;
 }
 
-uint8_t nes6502::NOP()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::NOP()
 {
+	//the unofficial nops with an operand still read it, side effects included
+	fetch();
 	switch (opcode) {
 	case 0x1C:
 	case 0x3C:
@@ -611,7 +774,8 @@ uint8_t nes6502::NOP()
 	return 0;
 }
 
-uint8_t nes6502::ORA()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::ORA()
 {
 	fetch();
 	reg_a = reg_a | fetched;
@@ -620,14 +784,16 @@ uint8_t nes6502::ORA()
 	return 1;
 }
 
-uint8_t nes6502::PHA()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::PHA()
 {
 	write(0x0100 + sp, reg_a);
 	sp--;
 	return 0;
 }
 
-uint8_t nes6502::PHP()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::PHP()
 {
 	write(0x0100 + sp--, status_reg | B | U);
 	setFlag(B, 0);
@@ -635,45 +801,58 @@ uint8_t nes6502::PHP()
 	return 0;
 }
 
-uint8_t nes6502::PLA()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::PLA()
 {
+	dummyRead(0x0100 + sp);
 	reg_a = read(0x0100 + ++sp);
 	setFlag(Z, reg_a == 0);
-	setFlag(N, reg_a & 0xFF);
+	setFlag(N, reg_a & 0x80);
 	return 0;
 }
 
-uint8_t nes6502::PLP()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::PLP()
 {
+	dummyRead(0x0100 + sp);
 	sp++;
 	status_reg = read(0x0100 + sp);
 	setFlag(U, 1);
 	return 0;
 }
 
-uint8_t nes6502::ROL()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::ROL()
 {
 	fetch();
 	uint16_t temp = (uint16_t)fetched << 1 | getFlag(C);
-	setFlag(C, temp & 0xFF00);
+	setFlag(C, (temp & 0xFF00) > 0);
 	setFlag(Z, (temp & 0x00FF) == 0);
 	setFlag(N, temp & 0x0080);
 
-	if (instructions[opcode].addrmode == &nes6502::IMP) reg_a = temp & 0x00FF;
-	else write(addr_abs, temp & 0x00FF);
+	if (instructions[opcode].addrmode == &nes6502Core::ACC) reg_a = temp & 0x00FF;
+	else
+	{
+		dummyWrite(addr_abs, fetched);
+		write(addr_abs, temp & 0x00FF);
+	}
 
 	return 0;
 }
 
-uint8_t nes6502::ROR()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::ROR()
 {
 	fetch();
 	uint16_t temp = (uint16_t)(getFlag(C) << 7) | (fetched >> 1);
 
-	if (instructions[opcode].addrmode == &nes6502::ACC)
+	if (instructions[opcode].addrmode == &nes6502Core::ACC)
 		reg_a = temp & 0x00FF;
 	else
+	{
+		dummyWrite(addr_abs, fetched);
 		write(addr_abs, temp & 0x00FF);
+	}
 
 	setFlag(C, fetched & 0x01);
 	setFlag(Z, (temp & 0x00FF) == 0x00);
@@ -682,8 +861,10 @@ uint8_t nes6502::ROR()
 	return 0;
 }
 
-uint8_t nes6502::RTI()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::RTI()
 {
+	dummyRead(0x0100 + sp);
 	sp++;
 	status_reg = read(0x0100 + sp);
 	status_reg &= ~B;
@@ -696,18 +877,22 @@ uint8_t nes6502::RTI()
 	return 0;
 }
 
-uint8_t nes6502::RTS()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::RTS()
 {
+	dummyRead(0x0100 + sp);
 	sp++;
 	pc = (uint16_t)read(0x0100 + sp);
 	sp++;
 	pc |= (uint16_t)read(0x0100 + sp) << 8;
+	dummyRead(pc);
 	pc++;
 
 	return 0;
 }
 
-uint8_t nes6502::SBC()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::SBC()
 {
 	fetch();
 	uint16_t temp = (uint16_t)reg_a + (((uint16_t)fetched) ^ 0x00FF) + (uint16_t)getFlag(C);
@@ -718,7 +903,7 @@ uint8_t nes6502::SBC()
 
 	uint8_t is_v = a && !b && !c || !a && b && c;
 
-	setFlag(C, temp & 0xFF00);
+	setFlag(C, (temp & 0xFF00) > 0);
 	setFlag(Z, (temp & 0x00FF) == 0);
 	setFlag(N, temp & 0x0080);
 	setFlag(V, is_v);
@@ -728,43 +913,50 @@ uint8_t nes6502::SBC()
 	return 1;
 }
 
-uint8_t nes6502::SEC()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::SEC()
 {
 	setFlag(C, 1);
 	return 0;
 }
 
-uint8_t nes6502::SED()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::SED()
 {
 	setFlag(D, 1);
 	return 0;
 }
 
-uint8_t nes6502::SEI()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::SEI()
 {
 	setFlag(I, 1);
 	return 0;
 }
 
-uint8_t nes6502::STA()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::STA()
 {
 	write(addr_abs, reg_a);
 	return 0;
 }
 
-uint8_t nes6502::STX()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::STX()
 {
 	write(addr_abs, reg_x);
 	return 0;
 }
 
-uint8_t nes6502::STY()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::STY()
 {
 	write(addr_abs, reg_y);
 	return 0;
 }
 
-uint8_t nes6502::TAX()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::TAX()
 {
 	reg_x = reg_a;
 	setFlag(Z, reg_x == 0x00);
@@ -772,7 +964,8 @@ uint8_t nes6502::TAX()
 	return 0;
 }
 
-uint8_t nes6502::TAY()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::TAY()
 {
 	reg_y = reg_a;
 	setFlag(Z, reg_y == 0x00);
@@ -780,7 +973,8 @@ uint8_t nes6502::TAY()
 	return 0;
 }
 
-uint8_t nes6502::TSX()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::TSX()
 {
 	reg_x = sp;
 
@@ -790,7 +984,8 @@ uint8_t nes6502::TSX()
 	return 0;
 }
 
-uint8_t nes6502::TXA()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::TXA()
 {
 	reg_a = reg_x;
 
@@ -800,13 +995,15 @@ uint8_t nes6502::TXA()
 	return 0;
 }
 
-uint8_t nes6502::TXS()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::TXS()
 {
 	sp = reg_x;
 	return 0;
 }
 
-uint8_t nes6502::TYA()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::TYA()
 {
 	reg_a = reg_y;
 	setFlag(Z, reg_a == 0x00);
@@ -814,19 +1011,28 @@ uint8_t nes6502::TYA()
 	return 0;
 }
 
-uint8_t nes6502::XXX()
+template <CpuAccuracy accuracy>
+uint8_t nes6502Core<accuracy>::XXX()
 {
 	return 0;
 }
 
-void nes6502::branch(Flags flag, uint8_t condition)
+template <CpuAccuracy accuracy>
+void nes6502Core<accuracy>::branch(Flags flag, uint8_t condition)
 {
 	if (getFlag(flag) == condition)
 	{
+		dummyRead(pc);
 		addr_abs = pc + addr_rel;
 		cycles++;
 		if ((addr_abs & 0xFF00) != (pc & 0xFF00))
+		{
+			dummyRead((pc & 0xFF00) | (addr_abs & 0x00FF));
 			cycles++;
+		}
 		pc = addr_abs;
 	}
 }
+
+template class nes6502Core<CpuAccuracy::Fast>;
+template class nes6502Core<CpuAccuracy::CycleExact>;
@@ -2,13 +2,33 @@
 
 #include <memory>
 #include <string>
-#include <vector>
-#include <map>
+#include <string_view>
+#include <cinttypes>
 
 class Bus;
+class StateWriter;
+class StateReader;
 
-class nes6502
+enum class CpuAccuracy
 {
+	//the whole instruction runs on its first cycle, the rest are idle
+	Fast,
+	//every bus access, dummy reads/writes included, lands on its own cycle
+	CycleExact
+};
+
+//operand formats, for tools that decode instructions without running them
+enum class AddressMode : uint8_t
+{
+	IMP, ACC, IMM, ZP0, ZPX, ZPY, REL, ABS, ABX, ABY, IND, IZX, IZY
+};
+
+template <CpuAccuracy accuracy>
+class nes6502Core
+{
+public:
+	static constexpr CpuAccuracy tier = accuracy;
+
 private:
 	enum Flags
 	{
@@ -24,46 +44,35 @@ private:
 
 	struct Instruction
 	{
-		std::string name;
-		uint8_t(nes6502::* opcode)(void) = nullptr;
-		uint8_t(nes6502::* addrmode)(void) = nullptr;
+		std::string_view name;
+		uint8_t(nes6502Core::* opcode)(void) = nullptr;
+		uint8_t(nes6502Core::* addrmode)(void) = nullptr;
 		uint8_t cycle = 0;
 	};
 
+	//widest members first so the whole register file packs without padding
+	Bus* bus;
+
+public:
+	uint16_t pc = 0;
+
+private:
+	uint16_t addr_abs = 0;
+	uint16_t addr_rel = 0;
+
 public:
 	uint8_t  reg_a = 0;
 	uint8_t  reg_x = 0;
 	uint8_t  reg_y = 0;
 	uint8_t  sp = 0;
-	uint16_t pc = 0;
 	uint8_t	 status_reg = 0;
 	uint8_t	 cycles = 0;
 
 private:
-	uint16_t addr_abs = 0;
-	uint16_t  addr_rel = 0;
 	uint8_t  fetched = 0;
 	uint8_t	 opcode = 0;
-	Bus* bus;
-	std::vector<Instruction> instructions =
-	{
-		{"BRK", &nes6502::BRK, &nes6502::IMP, 7}, {"ORA", &nes6502::ORA, &nes6502::IZX, 6}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"ORA", &nes6502::ORA, &nes6502::ZP0, 3}, {"ASL", &nes6502::ASL, &nes6502::ZP0, 5}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"PHP", &nes6502::PHP, &nes6502::IMP, 3}, {"ORA", &nes6502::ORA, &nes6502::IMM, 2}, {"ASL", &nes6502::ASL, &nes6502::ACC, 2}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"ORA", &nes6502::ORA, &nes6502::ABS, 4}, {"ASL", &nes6502::ASL, &nes6502::ABS, 6}, {"???", &nes6502::XXX, &nes6502::IMP, 8},
-		{"BPL", &nes6502::BPL, &nes6502::REL, 2}, {"ORA", &nes6502::ORA, &nes6502::IZY, 5}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"ORA", &nes6502::ORA, &nes6502::ZPX, 4}, {"ASL", &nes6502::ASL, &nes6502::ZPX, 6}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"CLC", &nes6502::CLC, &nes6502::IMP, 2}, {"ORA", &nes6502::ORA, &nes6502::ABY, 4}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"ORA", &nes6502::ORA, &nes6502::ABX, 4}, {"ASL", &nes6502::ASL, &nes6502::ABX, 7}, {"???", &nes6502::XXX, &nes6502::IMP, 8},
-		{"JSR", &nes6502::JSR, &nes6502::ABS, 6}, {"AND", &nes6502::AND, &nes6502::IZX, 6}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"BIT", &nes6502::BIT, &nes6502::ZP0, 3}, {"AND", &nes6502::AND, &nes6502::ZP0, 3}, {"ROL", &nes6502::ROL, &nes6502::ZP0, 6}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"PLP", &nes6502::PLP, &nes6502::IMP, 4}, {"AND", &nes6502::AND, &nes6502::IMM, 2}, {"ROL", &nes6502::ROL, &nes6502::ACC, 2}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"BIT", &nes6502::BIT, &nes6502::ABS, 4}, {"AND", &nes6502::AND, &nes6502::ABS, 4}, {"ROL", &nes6502::ROL, &nes6502::ABS, 6}, {"???", &nes6502::XXX, &nes6502::IMP, 8},
-		{"BMI", &nes6502::BMI, &nes6502::REL, 2}, {"AND", &nes6502::AND, &nes6502::IZY, 5}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"AND", &nes6502::AND, &nes6502::ZPX, 4}, {"ROL", &nes6502::ROL, &nes6502::ZPX, 6}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"SEC", &nes6502::SEC, &nes6502::IMP, 2}, {"AND", &nes6502::AND, &nes6502::ABY, 4}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"AND", &nes6502::AND, &nes6502::ABX, 4}, {"ROL", &nes6502::ROL, &nes6502::ABX, 7}, {"???", &nes6502::XXX, &nes6502::IMP, 8},
-		{"RTI", &nes6502::RTI, &nes6502::IMP, 6}, {"EOR", &nes6502::EOR, &nes6502::IZX, 6}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"EOR", &nes6502::EOR, &nes6502::ZP0, 3}, {"LSR", &nes6502::LSR, &nes6502::ZP0, 5}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"PHA", &nes6502::PHA, &nes6502::IMP, 3}, {"EOR", &nes6502::EOR, &nes6502::IMM, 2}, {"LSR", &nes6502::LSR, &nes6502::ACC, 2}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"JMP", &nes6502::JMP, &nes6502::ABS, 3}, {"EOR", &nes6502::EOR, &nes6502::ABS, 4}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"LSR", &nes6502::LSR, &nes6502::ABS, 6},
-		{"BVC", &nes6502::BVC, &nes6502::REL, 2}, {"EOR", &nes6502::EOR, &nes6502::IZY, 5}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"EOR", &nes6502::EOR, &nes6502::ZPX, 4}, {"LSR", &nes6502::LSR, &nes6502::ZPX, 6}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"CLI", &nes6502::CLI, &nes6502::IMP, 2}, {"EOR", &nes6502::EOR, &nes6502::ABY, 4}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"EOR", &nes6502::EOR, &nes6502::ABX, 4}, {"LSR", &nes6502::LSR, &nes6502::ABX, 7}, {"???", &nes6502::XXX, &nes6502::IMP, 8},
-		{"RTS", &nes6502::RTS, &nes6502::IMP, 6}, {"ADC", &nes6502::ADC, &nes6502::IZX, 6}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"ADC", &nes6502::ADC, &nes6502::ZP0, 3}, {"ROR", &nes6502::ROR, &nes6502::ZP0, 5}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"PLA", &nes6502::PLA, &nes6502::IMP, 4}, {"ADC", &nes6502::ADC, &nes6502::IMM, 2}, {"ROR", &nes6502::ROR, &nes6502::ACC, 2}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"JMP", &nes6502::JMP, &nes6502::IND, 5}, {"ADC", &nes6502::ADC, &nes6502::ABS, 4}, {"ROR", &nes6502::ROR, &nes6502::ABS, 6}, {"???", &nes6502::XXX, &nes6502::IMP, 8},
-		{"BVS", &nes6502::BVS, &nes6502::REL, 2}, {"ADC", &nes6502::ADC, &nes6502::IZY, 5}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"ADC", &nes6502::ADC, &nes6502::ZPX, 4}, {"ROR", &nes6502::ROR, &nes6502::ZPX, 6}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"SEI", &nes6502::SEI, &nes6502::IMP, 2}, {"ADC", &nes6502::ADC, &nes6502::ABY, 4}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"ADC", &nes6502::ADC, &nes6502::ABX, 4}, {"ROR", &nes6502::ROR, &nes6502::ABX, 7}, {"???", &nes6502::XXX, &nes6502::IMP, 8},
-		{"???", &nes6502::XXX, &nes6502::IMP, 8}, {"STA", &nes6502::STA, &nes6502::IZX, 6}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"STY", &nes6502::STY, &nes6502::ZP0, 3}, {"STA", &nes6502::STA, &nes6502::ZP0, 3}, {"STX", &nes6502::STX, &nes6502::ZP0, 3}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"DEY", &nes6502::DEY, &nes6502::IMP, 2}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"TXA", &nes6502::TXA, &nes6502::IMP, 2}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"STY", &nes6502::STY, &nes6502::ABS, 4}, {"STA", &nes6502::STA, &nes6502::ABS, 4}, {"STX", &nes6502::STX, &nes6502::ABS, 4}, {"???", &nes6502::XXX, &nes6502::IMP, 8},
-		{"BCC", &nes6502::BCC, &nes6502::REL, 2}, {"STA", &nes6502::STA, &nes6502::IZY, 6}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"STY", &nes6502::STY, &nes6502::ZPX, 4}, {"STA", &nes6502::STA, &nes6502::ZPX, 4}, {"STX", &nes6502::STX, &nes6502::ZPY, 5}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"TYA", &nes6502::TYA, &nes6502::IMP, 2}, {"STA", &nes6502::STA, &nes6502::ABY, 5}, {"TXS", &nes6502::TXS, &nes6502::IMP, 2}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"STA", &nes6502::STA, &nes6502::ABX, 5}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"???", &nes6502::XXX, &nes6502::IMP, 8},
-		{"LDY", &nes6502::LDY, &nes6502::IMM, 2}, {"LDA", &nes6502::LDA, &nes6502::IZX, 6}, {"LDX", &nes6502::LDX, &nes6502::IMM, 2}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"LDY", &nes6502::LDY, &nes6502::ZP0, 3}, {"LDA", &nes6502::LDA, &nes6502::ZP0, 3}, {"LDX", &nes6502::LDX, &nes6502::ZP0, 3}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"TAY", &nes6502::TAY, &nes6502::IMP, 2}, {"LDA", &nes6502::LDA, &nes6502::IMM, 2}, {"TAX", &nes6502::TAX, &nes6502::IMP, 2}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"LDY", &nes6502::LDY, &nes6502::ABS, 4}, {"LDA", &nes6502::LDA, &nes6502::ABS, 4}, {"LDX", &nes6502::LDX, &nes6502::ABS, 4}, {"???", &nes6502::XXX, &nes6502::IMP, 8},
-		{"BCS", &nes6502::BCS, &nes6502::REL, 2}, {"LDA", &nes6502::LDA, &nes6502::IZY, 5}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"LDY", &nes6502::LDY, &nes6502::ZPX, 4}, {"LDA", &nes6502::LDA, &nes6502::ZPX, 4}, {"LDX", &nes6502::LDX, &nes6502::ZPY, 4}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"CLV", &nes6502::CLV, &nes6502::IMP, 2}, {"LDA", &nes6502::LDA, &nes6502::ABY, 4}, {"TSX", &nes6502::TSX, &nes6502::IMP, 2}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"LDY", &nes6502::LDY, &nes6502::ABX, 4}, {"LDA", &nes6502::LDA, &nes6502::ABX, 4}, {"LDX", &nes6502::LDX, &nes6502::ABY, 4}, {"???", &nes6502::XXX, &nes6502::IMP, 8},
-		{"CPY", &nes6502::CPY, &nes6502::IMM, 2}, {"CMP", &nes6502::CMP, &nes6502::IZX, 6}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"CPY", &nes6502::CPY, &nes6502::ZP0, 3}, {"CMP", &nes6502::CMP, &nes6502::ZP0, 3}, {"DEC", &nes6502::DEC, &nes6502::ZP0, 5}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"INY", &nes6502::INY, &nes6502::IMP, 2}, {"CMP", &nes6502::CMP, &nes6502::IMM, 2}, {"DEX", &nes6502::DEX, &nes6502::IMP, 2}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"CPY", &nes6502::CPY, &nes6502::ABS, 4}, {"CMP", &nes6502::CMP, &nes6502::ABS, 4}, {"DEC", &nes6502::DEC, &nes6502::ABS, 6}, {"???", &nes6502::XXX, &nes6502::IMP, 8},
-		{"BNE", &nes6502::BNE, &nes6502::REL, 2}, {"CMP", &nes6502::CMP, &nes6502::IZY, 5}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"CMP", &nes6502::CMP, &nes6502::ZPX, 4}, {"DEC", &nes6502::DEC, &nes6502::ZPX, 6}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"CLD", &nes6502::CLD, &nes6502::IMP, 2}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"CMP", &nes6502::CMP, &nes6502::ABX, 4}, {"DEC", &nes6502::DEC, &nes6502::ABX, 7}, {"???", &nes6502::XXX, &nes6502::IMP, 8},
-		{"CPX", &nes6502::CPX, &nes6502::IMM, 2}, {"SBC", &nes6502::SBC, &nes6502::IZX, 6}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"CPX", &nes6502::CPX, &nes6502::ZP0, 3}, {"SBC", &nes6502::SBC, &nes6502::ZP0, 3}, {"INC", &nes6502::INC, &nes6502::ZP0, 5}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"INX", &nes6502::INX, &nes6502::IMP, 2}, {"SBC", &nes6502::SBC, &nes6502::IMM, 2}, {"NOP", &nes6502::NOP, &nes6502::IMP, 2}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"CPX", &nes6502::CPX, &nes6502::ABS, 4}, {"SBC", &nes6502::SBC, &nes6502::ABS, 4}, {"INC", &nes6502::INC, &nes6502::ABS, 6}, {"???", &nes6502::XXX, &nes6502::IMP, 8},
-		{"BEQ", &nes6502::BEQ, &nes6502::REL, 2}, {"SBC", &nes6502::SBC, &nes6502::IZY, 5}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"SBC", &nes6502::SBC, &nes6502::ZPX, 4}, {"INC", &nes6502::INC, &nes6502::ZPX, 6}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"SED", &nes6502::SED, &nes6502::IMP, 2}, {"SBC", &nes6502::SBC, &nes6502::ABY, 4}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"???", &nes6502::XXX, &nes6502::IMP, 8}, {"SBC", &nes6502::SBC, &nes6502::ABX, 5}, {"INC", &nes6502::INC, &nes6502::ABX, 7}, {"???", &nes6502::XXX, &nes6502::IMP, 8}
-	};
+	//bus cycles used by the current instruction, only tracked by the cycle-exact tier
+	uint8_t  busCycles = 0;
 
 	uint8_t IMM();	uint8_t IMP();
 	uint8_t ZP0();	uint8_t ZPX();
@@ -91,8 +100,36 @@ private:
 
 	void branch(Flags flag, uint8_t condition);
 
+	//accesses that only exist to keep the cycle-exact tier on time, no-ops in the fast tier
+	void dummyRead(uint16_t addr);
+	void dummyWrite(uint16_t addr, uint8_t data);
+	bool writesOperand() const;
+	//hands the instruction that started at start to the bus's profiler, empty without NES_PROFILE
+	void profile(uint16_t start);
+
+	//opcode metadata is identical for every cpu, so it lives in one shared read-only table
+	static constexpr Instruction instructions[256] =
+	{
+		{"BRK", &nes6502Core::BRK, &nes6502Core::IMP, 7}, {"ORA", &nes6502Core::ORA, &nes6502Core::IZX, 6}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"NOP", &nes6502Core::NOP, &nes6502Core::ZP0, 3}, {"ORA", &nes6502Core::ORA, &nes6502Core::ZP0, 3}, {"ASL", &nes6502Core::ASL, &nes6502Core::ZP0, 5}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"PHP", &nes6502Core::PHP, &nes6502Core::IMP, 3}, {"ORA", &nes6502Core::ORA, &nes6502Core::IMM, 2}, {"ASL", &nes6502Core::ASL, &nes6502Core::ACC, 2}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"NOP", &nes6502Core::NOP, &nes6502Core::ABS, 4}, {"ORA", &nes6502Core::ORA, &nes6502Core::ABS, 4}, {"ASL", &nes6502Core::ASL, &nes6502Core::ABS, 6}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8},
+		{"BPL", &nes6502Core::BPL, &nes6502Core::REL, 2}, {"ORA", &nes6502Core::ORA, &nes6502Core::IZY, 5}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"NOP", &nes6502Core::NOP, &nes6502Core::ZPX, 4}, {"ORA", &nes6502Core::ORA, &nes6502Core::ZPX, 4}, {"ASL", &nes6502Core::ASL, &nes6502Core::ZPX, 6}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"CLC", &nes6502Core::CLC, &nes6502Core::IMP, 2}, {"ORA", &nes6502Core::ORA, &nes6502Core::ABY, 4}, {"NOP", &nes6502Core::NOP, &nes6502Core::IMP, 2}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"NOP", &nes6502Core::NOP, &nes6502Core::ABX, 4}, {"ORA", &nes6502Core::ORA, &nes6502Core::ABX, 4}, {"ASL", &nes6502Core::ASL, &nes6502Core::ABX, 7}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8},
+		{"JSR", &nes6502Core::JSR, &nes6502Core::ABS, 6}, {"AND", &nes6502Core::AND, &nes6502Core::IZX, 6}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"BIT", &nes6502Core::BIT, &nes6502Core::ZP0, 3}, {"AND", &nes6502Core::AND, &nes6502Core::ZP0, 3}, {"ROL", &nes6502Core::ROL, &nes6502Core::ZP0, 5}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"PLP", &nes6502Core::PLP, &nes6502Core::IMP, 4}, {"AND", &nes6502Core::AND, &nes6502Core::IMM, 2}, {"ROL", &nes6502Core::ROL, &nes6502Core::ACC, 2}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"BIT", &nes6502Core::BIT, &nes6502Core::ABS, 4}, {"AND", &nes6502Core::AND, &nes6502Core::ABS, 4}, {"ROL", &nes6502Core::ROL, &nes6502Core::ABS, 6}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8},
+		{"BMI", &nes6502Core::BMI, &nes6502Core::REL, 2}, {"AND", &nes6502Core::AND, &nes6502Core::IZY, 5}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"NOP", &nes6502Core::NOP, &nes6502Core::ZPX, 4}, {"AND", &nes6502Core::AND, &nes6502Core::ZPX, 4}, {"ROL", &nes6502Core::ROL, &nes6502Core::ZPX, 6}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"SEC", &nes6502Core::SEC, &nes6502Core::IMP, 2}, {"AND", &nes6502Core::AND, &nes6502Core::ABY, 4}, {"NOP", &nes6502Core::NOP, &nes6502Core::IMP, 2}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"NOP", &nes6502Core::NOP, &nes6502Core::ABX, 4}, {"AND", &nes6502Core::AND, &nes6502Core::ABX, 4}, {"ROL", &nes6502Core::ROL, &nes6502Core::ABX, 7}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8},
+		{"RTI", &nes6502Core::RTI, &nes6502Core::IMP, 6}, {"EOR", &nes6502Core::EOR, &nes6502Core::IZX, 6}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"NOP", &nes6502Core::NOP, &nes6502Core::ZP0, 3}, {"EOR", &nes6502Core::EOR, &nes6502Core::ZP0, 3}, {"LSR", &nes6502Core::LSR, &nes6502Core::ZP0, 5}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"PHA", &nes6502Core::PHA, &nes6502Core::IMP, 3}, {"EOR", &nes6502Core::EOR, &nes6502Core::IMM, 2}, {"LSR", &nes6502Core::LSR, &nes6502Core::ACC, 2}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"JMP", &nes6502Core::JMP, &nes6502Core::ABS, 3}, {"EOR", &nes6502Core::EOR, &nes6502Core::ABS, 4}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"LSR", &nes6502Core::LSR, &nes6502Core::ABS, 6},
+		{"BVC", &nes6502Core::BVC, &nes6502Core::REL, 2}, {"EOR", &nes6502Core::EOR, &nes6502Core::IZY, 5}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"NOP", &nes6502Core::NOP, &nes6502Core::ZPX, 4}, {"EOR", &nes6502Core::EOR, &nes6502Core::ZPX, 4}, {"LSR", &nes6502Core::LSR, &nes6502Core::ZPX, 6}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"CLI", &nes6502Core::CLI, &nes6502Core::IMP, 2}, {"EOR", &nes6502Core::EOR, &nes6502Core::ABY, 4}, {"NOP", &nes6502Core::NOP, &nes6502Core::IMP, 2}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"NOP", &nes6502Core::NOP, &nes6502Core::ABX, 4}, {"EOR", &nes6502Core::EOR, &nes6502Core::ABX, 4}, {"LSR", &nes6502Core::LSR, &nes6502Core::ABX, 7}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8},
+		{"RTS", &nes6502Core::RTS, &nes6502Core::IMP, 6}, {"ADC", &nes6502Core::ADC, &nes6502Core::IZX, 6}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"NOP", &nes6502Core::NOP, &nes6502Core::ZP0, 3}, {"ADC", &nes6502Core::ADC, &nes6502Core::ZP0, 3}, {"ROR", &nes6502Core::ROR, &nes6502Core::ZP0, 5}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"PLA", &nes6502Core::PLA, &nes6502Core::IMP, 4}, {"ADC", &nes6502Core::ADC, &nes6502Core::IMM, 2}, {"ROR", &nes6502Core::ROR, &nes6502Core::ACC, 2}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"JMP", &nes6502Core::JMP, &nes6502Core::IND, 5}, {"ADC", &nes6502Core::ADC, &nes6502Core::ABS, 4}, {"ROR", &nes6502Core::ROR, &nes6502Core::ABS, 6}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8},
+		{"BVS", &nes6502Core::BVS, &nes6502Core::REL, 2}, {"ADC", &nes6502Core::ADC, &nes6502Core::IZY, 5}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"NOP", &nes6502Core::NOP, &nes6502Core::ZPX, 4}, {"ADC", &nes6502Core::ADC, &nes6502Core::ZPX, 4}, {"ROR", &nes6502Core::ROR, &nes6502Core::ZPX, 6}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"SEI", &nes6502Core::SEI, &nes6502Core::IMP, 2}, {"ADC", &nes6502Core::ADC, &nes6502Core::ABY, 4}, {"NOP", &nes6502Core::NOP, &nes6502Core::IMP, 2}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"NOP", &nes6502Core::NOP, &nes6502Core::ABX, 4}, {"ADC", &nes6502Core::ADC, &nes6502Core::ABX, 4}, {"ROR", &nes6502Core::ROR, &nes6502Core::ABX, 7}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8},
+		{"NOP", &nes6502Core::NOP, &nes6502Core::IMM, 2}, {"STA", &nes6502Core::STA, &nes6502Core::IZX, 6}, {"NOP", &nes6502Core::NOP, &nes6502Core::IMM, 2}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"STY", &nes6502Core::STY, &nes6502Core::ZP0, 3}, {"STA", &nes6502Core::STA, &nes6502Core::ZP0, 3}, {"STX", &nes6502Core::STX, &nes6502Core::ZP0, 3}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"DEY", &nes6502Core::DEY, &nes6502Core::IMP, 2}, {"NOP", &nes6502Core::NOP, &nes6502Core::IMM, 2}, {"TXA", &nes6502Core::TXA, &nes6502Core::IMP, 2}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"STY", &nes6502Core::STY, &nes6502Core::ABS, 4}, {"STA", &nes6502Core::STA, &nes6502Core::ABS, 4}, {"STX", &nes6502Core::STX, &nes6502Core::ABS, 4}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8},
+		{"BCC", &nes6502Core::BCC, &nes6502Core::REL, 2}, {"STA", &nes6502Core::STA, &nes6502Core::IZY, 6}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"STY", &nes6502Core::STY, &nes6502Core::ZPX, 4}, {"STA", &nes6502Core::STA, &nes6502Core::ZPX, 4}, {"STX", &nes6502Core::STX, &nes6502Core::ZPY, 4}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"TYA", &nes6502Core::TYA, &nes6502Core::IMP, 2}, {"STA", &nes6502Core::STA, &nes6502Core::ABY, 5}, {"TXS", &nes6502Core::TXS, &nes6502Core::IMP, 2}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"STA", &nes6502Core::STA, &nes6502Core::ABX, 5}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8},
+		{"LDY", &nes6502Core::LDY, &nes6502Core::IMM, 2}, {"LDA", &nes6502Core::LDA, &nes6502Core::IZX, 6}, {"LDX", &nes6502Core::LDX, &nes6502Core::IMM, 2}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"LDY", &nes6502Core::LDY, &nes6502Core::ZP0, 3}, {"LDA", &nes6502Core::LDA, &nes6502Core::ZP0, 3}, {"LDX", &nes6502Core::LDX, &nes6502Core::ZP0, 3}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"TAY", &nes6502Core::TAY, &nes6502Core::IMP, 2}, {"LDA", &nes6502Core::LDA, &nes6502Core::IMM, 2}, {"TAX", &nes6502Core::TAX, &nes6502Core::IMP, 2}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"LDY", &nes6502Core::LDY, &nes6502Core::ABS, 4}, {"LDA", &nes6502Core::LDA, &nes6502Core::ABS, 4}, {"LDX", &nes6502Core::LDX, &nes6502Core::ABS, 4}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8},
+		{"BCS", &nes6502Core::BCS, &nes6502Core::REL, 2}, {"LDA", &nes6502Core::LDA, &nes6502Core::IZY, 5}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"LDY", &nes6502Core::LDY, &nes6502Core::ZPX, 4}, {"LDA", &nes6502Core::LDA, &nes6502Core::ZPX, 4}, {"LDX", &nes6502Core::LDX, &nes6502Core::ZPY, 4}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"CLV", &nes6502Core::CLV, &nes6502Core::IMP, 2}, {"LDA", &nes6502Core::LDA, &nes6502Core::ABY, 4}, {"TSX", &nes6502Core::TSX, &nes6502Core::IMP, 2}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"LDY", &nes6502Core::LDY, &nes6502Core::ABX, 4}, {"LDA", &nes6502Core::LDA, &nes6502Core::ABX, 4}, {"LDX", &nes6502Core::LDX, &nes6502Core::ABY, 4}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8},
+		{"CPY", &nes6502Core::CPY, &nes6502Core::IMM, 2}, {"CMP", &nes6502Core::CMP, &nes6502Core::IZX, 6}, {"NOP", &nes6502Core::NOP, &nes6502Core::IMM, 2}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"CPY", &nes6502Core::CPY, &nes6502Core::ZP0, 3}, {"CMP", &nes6502Core::CMP, &nes6502Core::ZP0, 3}, {"DEC", &nes6502Core::DEC, &nes6502Core::ZP0, 5}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"INY", &nes6502Core::INY, &nes6502Core::IMP, 2}, {"CMP", &nes6502Core::CMP, &nes6502Core::IMM, 2}, {"DEX", &nes6502Core::DEX, &nes6502Core::IMP, 2}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"CPY", &nes6502Core::CPY, &nes6502Core::ABS, 4}, {"CMP", &nes6502Core::CMP, &nes6502Core::ABS, 4}, {"DEC", &nes6502Core::DEC, &nes6502Core::ABS, 6}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8},
+		{"BNE", &nes6502Core::BNE, &nes6502Core::REL, 2}, {"CMP", &nes6502Core::CMP, &nes6502Core::IZY, 5}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"NOP", &nes6502Core::NOP, &nes6502Core::ZPX, 4}, {"CMP", &nes6502Core::CMP, &nes6502Core::ZPX, 4}, {"DEC", &nes6502Core::DEC, &nes6502Core::ZPX, 6}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"CLD", &nes6502Core::CLD, &nes6502Core::IMP, 2}, {"CMP", &nes6502Core::CMP, &nes6502Core::ABY, 4}, {"NOP", &nes6502Core::NOP, &nes6502Core::IMP, 2}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"NOP", &nes6502Core::NOP, &nes6502Core::ABX, 4}, {"CMP", &nes6502Core::CMP, &nes6502Core::ABX, 4}, {"DEC", &nes6502Core::DEC, &nes6502Core::ABX, 7}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8},
+		{"CPX", &nes6502Core::CPX, &nes6502Core::IMM, 2}, {"SBC", &nes6502Core::SBC, &nes6502Core::IZX, 6}, {"NOP", &nes6502Core::NOP, &nes6502Core::IMM, 2}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"CPX", &nes6502Core::CPX, &nes6502Core::ZP0, 3}, {"SBC", &nes6502Core::SBC, &nes6502Core::ZP0, 3}, {"INC", &nes6502Core::INC, &nes6502Core::ZP0, 5}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"INX", &nes6502Core::INX, &nes6502Core::IMP, 2}, {"SBC", &nes6502Core::SBC, &nes6502Core::IMM, 2}, {"NOP", &nes6502Core::NOP, &nes6502Core::IMP, 2}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"CPX", &nes6502Core::CPX, &nes6502Core::ABS, 4}, {"SBC", &nes6502Core::SBC, &nes6502Core::ABS, 4}, {"INC", &nes6502Core::INC, &nes6502Core::ABS, 6}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8},
+		{"BEQ", &nes6502Core::BEQ, &nes6502Core::REL, 2}, {"SBC", &nes6502Core::SBC, &nes6502Core::IZY, 5}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"NOP", &nes6502Core::NOP, &nes6502Core::ZPX, 4}, {"SBC", &nes6502Core::SBC, &nes6502Core::ZPX, 4}, {"INC", &nes6502Core::INC, &nes6502Core::ZPX, 6}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"SED", &nes6502Core::SED, &nes6502Core::IMP, 2}, {"SBC", &nes6502Core::SBC, &nes6502Core::ABY, 4}, {"NOP", &nes6502Core::NOP, &nes6502Core::IMP, 2}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}, {"NOP", &nes6502Core::NOP, &nes6502Core::ABX, 4}, {"SBC", &nes6502Core::SBC, &nes6502Core::ABX, 4}, {"INC", &nes6502Core::INC, &nes6502Core::ABX, 7}, {"???", &nes6502Core::XXX, &nes6502Core::IMP, 8}
+	};
+
 public:
-	nes6502(Bus* bus)
+	nes6502Core(Bus* bus)
 		: bus(bus)
 	{}
 
@@ -103,12 +140,35 @@ public:
 	void irq();
 	void nmi();
 
-	uint8_t read(uint16_t addr) const;
-	void write(uint16_t addr, uint8_t data) const;
+	uint8_t read(uint16_t addr);
+	void write(uint16_t addr, uint8_t data);
 
 	uint8_t getFlag(Flags flagName);
 	void setFlag(Flags flagName, uint8_t data);
-	
-	std::map<uint16_t, std::string> dissamble(uint16_t start, uint16_t end) const;
+	//memory address the last instruction operated on, stale for implied and accumulator modes
+	uint16_t getEffectiveAddress() const { return addr_abs; }
+
+	//decoding without a cpu, see Disassembly
+	static std::string_view opcodeName(uint8_t opcode) { return instructions[opcode].name; }
+	static AddressMode addressMode(uint8_t opcode);
+	//cycles before page crosses and taken branches
+	static uint8_t baseCycles(uint8_t opcode) { return instructions[opcode].cycle; }
+
+	void saveState(StateWriter& writer) const;
+	bool loadState(const StateReader& reader);
+
+private:
+	struct State
+	{
+		uint16_t pc, addr_abs, addr_rel;
+		uint8_t reg_a, reg_x, reg_y, sp, status_reg, cycles, fetched, opcode, busCycles;
+	};
 };
 
+#ifdef NES_CYCLE_EXACT
+using nes6502 = nes6502Core<CpuAccuracy::CycleExact>;
+#else
+using nes6502 = nes6502Core<CpuAccuracy::Fast>;
+#endif
+
+static_assert(sizeof(nes6502) <= 64, "cpu registers should fit in one cache line");